@@ -14,21 +14,120 @@
  * Once all rooms are cleared, the run ends.
  * Press r to start a new run.
  * Press ESC to quit.
- * Build (Visual Studio / MSVC): cl /O2 /std:c++17 isaac_like.cpp user32.lib gdi32.lib
- * Build (MinGW/Clang): g++ isaac_like.cpp -std=c++17 -O2 -lgdi32 -o isaac_like.exe
+ * Build (Visual Studio / MSVC): cl /O2 /std:c++17 isaac_like.cpp user32.lib gdi32.lib winmm.lib ws2_32.lib
+ * Build (MinGW/Clang): g++ isaac_like.cpp -std=c++17 -O2 -lgdi32 -lwinmm -lws2_32 -o isaac_like.exe
+ * Build (Linux/X11): g++ isaac_like.cpp -std=c++17 -O2 -lX11 -lXext -lpthread -o isaac_like
+ *   (no sound device there yet: audio is mixed into the null sink unless -wav is given;
+ *   -shm works headless only). Presents through MIT-SHM when the X server offers it and
+ *   falls back to XPutImage otherwise; runs under Xvfb (xvfb-run ./isaac_like -bench).
+ * Add -DISAAC_FIXED_MATH (MSVC: /DISAAC_FIXED_MATH) to simulate in deterministic fixed point.
+ * The framebuffer is BGRA8 (native DIB/X11 order); -DISAAC_FB_RGBA8 switches it to RGBA8 and
+ * presenters convert on the way out.
+ * Add -DISAAC_COUNT_ALLOCS to count every C++ heap allocation into the -metrics counter
+ * isaac_allocations_total (an atomic add per allocation, on every thread).
+ *
+ * COMMAND LINE:
+ *   -wav <file>  Write the game audio to a WAV file instead of the sound device
+ *   -nosound     Mix audio into a null sink
+ *   -bench       Run the micro-benchmarks, print results to stdout and exit
+ *                (redirect to a file: isaac_like.exe -bench > bench.txt)
+ *   -headless <frames>  Run without a window, driven by a scripted bot, for <frames> frames
+ *   -capture <file>     Record every presented frame; .y4m writes YUV4MPEG2 video, any other
+ *                       extension writes raw XOR-delta/RLE frames (see FrameCapture)
+ *   -shot <frame>       Headless: save a screenshot after the given frame
+ *   -stream <port>      Serve the framebuffer as tile deltas on 127.0.0.1:<port>
+ *   -view <port>        Open a window that shows a game streaming on 127.0.0.1:<port>
+ *   -shm <name>         Render straight into a named shared-memory frame ring (see ShmHeader)
+ *   -shm-read <name>    Reference reader: follow a -shm ring and report present-to-read latency
+ *   -seed <n>           Seed the dungeon RNG (default: random)
+ *   -hash-ticks <n>     Run n bot-driven ticks from the seed (default 1), print a hash of the
+ *                       game state and exit; with -expect <hex> exit 1 when it differs
+ *   -crt                Add CRT scanlines to the post-processing passes
+ *   -pal8               Rasterize the world into an 8-bit palettized layer, expanded to
+ *                       32-bit before lighting (enemy and player edges lose anti-aliasing)
+ *   -post-budget <ms>   Time budget for the post-processing passes (default 1.5); passes
+ *                       drop to half resolution or off while it is exceeded
+ *   -atlas <file>       Memory-map the sprite atlas from <file>; if it is missing, bake
+ *                       the atlas and write it there
+ *   -tick-hz <n>        Simulation rate (default 120). Bullets are swept, so lower rates
+ *                       stay correct and cost proportionally less CPU
+ *   -no-idle            Keep rendering and presenting every frame while nothing on screen
+ *                       changes (by default such frames are skipped and the loop blocks on
+ *                       input for up to 100 ms)
+ *   -endless <file>     Clearing a floor descends to a new one instead of ending the run;
+ *                       a 32-byte summary of each floor left behind is appended to <file>
+ *   -overlay            Start with the input-to-present latency overlay on (F3 toggles it
+ *                       in a window)
+ *   -profile            Headless only: time the frame zones (with hardware counters on
+ *                       Linux where perf_event_open allows it) and print them at exit
+ *   -metrics <port>     Serve live counters, gauges and frame-time quantiles in Prometheus
+ *                       text format on http://127.0.0.1:<port>/
+ *
+ * F12 saves shot_NNNN.qoi and shot_NNNN.png next to the executable.
  */
 
 // isaac_like.cpp
 // Tiny "Binding of Isaac"-style 1-floor demo in pure Win32 + software rendering.
-// No sprites: everything is rectangles/circles. Random rooms, clear-to-unlock doors,
-// simple enemies, bullets, health, a boss room, and run reset.
+// Shots are RLE sprites from a small atlas; the rest is rectangles and circles. Random
+// rooms, clear-to-unlock doors, simple enemies, bullets, health, a boss room, and run
+// reset.
 //
-// Build (MinGW/Clang): g++ isaac_like.cpp -std=c++17 -O2 -lgdi32 -o isaac_like.exe
-// Build (MSVC): cl /O2 /std:c++17 isaac_like.cpp user32.lib gdi32.lib
+// Build (MinGW/Clang): g++ isaac_like.cpp -std=c++17 -O2 -lgdi32 -lwinmm -lws2_32 -o isaac_like.exe
+// Build (MSVC): cl /O2 /std:c++17 isaac_like.cpp user32.lib gdi32.lib winmm.lib ws2_32.lib
+// Build (Linux): g++ isaac_like.cpp -std=c++17 -O2 -lX11 -lXext -lpthread -o isaac_like
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #include <windows.h>
+#include <mmsystem.h>
+#include <malloc.h> // _aligned_malloc
+#else
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define ISAAC_PERF_EVENTS // hardware counters for the profiler zones
+#endif
+#endif
+#include <emmintrin.h> // SSE2
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <functional>
 #include <vector>
 #include <array>
 #include <cmath>
@@ -36,98 +135,1251 @@
 #include <random>
 #include <algorithm> // for std::max, std::min, std::clamp
 
+#ifndef _WIN32
+// The few Win32 names the shared code uses, for the X11 build.
+struct RECT { long left, top, right, bottom; };
+static void InflateRect(RECT* r, int dx, int dy) { r->left -= dx; r->top -= dy; r->right += dx; r->bottom += dy; }
+enum { VK_ESCAPE = 0x1B, VK_LEFT = 0x25, VK_UP = 0x26, VK_RIGHT = 0x27, VK_DOWN = 0x28, VK_F3 = 0x72, VK_F12 = 0x7B };
+typedef int SOCKET;
+typedef unsigned short u_short;
+typedef const char* LPCTSTR;
+#define TEXT(s) s
+static const SOCKET INVALID_SOCKET = -1;
+static const int SD_BOTH = SHUT_RDWR;
+static int closesocket(SOCKET s) { return close(s); }
+static void Sleep(unsigned ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+#endif
+
 static const int WIDTH = 960;
 static const int HEIGHT = 540;
 
+#ifdef _WIN32
 static BITMAPINFO g_bmpInfo{};
+#endif
 static void* g_pixels = nullptr;
 static bool       g_running = true;
 
-inline uint32_t RGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
-    return (uint32_t(r)) | (uint32_t(g) << 8) | (uint32_t(b) << 16) | (uint32_t(a) << 24);
+// A block of 32-bit pixels the primitives can draw into. g_fb wraps the DIB backbuffer;
+// g_target is switched temporarily to render into offscreen layers (e.g. the HUD cache).
+// A surface with idx set is indexed (PAL8): primitives write palette indices there and
+// px is unused. Only rows [top, h) are drawn, which lets worker threads each take a
+// band of the same buffer (g_target is per thread).
+struct Surface {
+    uint32_t* px = nullptr;
+    uint8_t* idx = nullptr;
+    int w = 0, h = 0;
+    int top = 0;
+};
+static Surface  g_fb;
+static thread_local Surface* g_target = &g_fb;
+
+// Pixel layouts, named by byte order in memory. The framebuffer is 32-bit FB_FORMAT:
+// BGRA8, which is what a BI_RGB DIB and little-endian 24/32-bit X visuals scan out, or
+// RGBA8 when built with -DISAAC_FB_RGBA8. The other formats exist only as conversion
+// targets (see convertPixels).
+enum class PixelFormat : uint8_t { BGRA8, RGBA8, RGB565, RGB8, PAL8, COUNT };
+static const int PIXEL_BYTES[] = { 4, 4, 2, 3, 1 };
+static const char* PIXEL_NAMES[] = { "BGRA8", "RGBA8", "RGB565", "RGB8", "PAL8" };
+#ifdef ISAAC_FB_RGBA8
+static constexpr PixelFormat FB_FORMAT = PixelFormat::RGBA8;
+#else
+static constexpr PixelFormat FB_FORMAT = PixelFormat::BGRA8;
+#endif
+static constexpr int FB_SHIFT_R = FB_FORMAT == PixelFormat::RGBA8 ? 0 : 16;
+static constexpr int FB_SHIFT_B = 16 - FB_SHIFT_R;
+
+// Colours are folded into FB_FORMAT at compile time.
+constexpr uint32_t RGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+    return (uint32_t(r) << FB_SHIFT_R) | (uint32_t(g) << 8) | (uint32_t(b) << FB_SHIFT_B) | (uint32_t(a) << 24);
+}
+constexpr int pxR(uint32_t p) { return int(p >> FB_SHIFT_R) & 0xFF; }
+constexpr int pxG(uint32_t p) { return int(p >> 8) & 0xFF; }
+constexpr int pxB(uint32_t p) { return int(p >> FB_SHIFT_B) & 0xFF; }
+static_assert(RGBA(1, 2, 3) == (FB_FORMAT == PixelFormat::BGRA8 ? 0xFF010203u : 0xFF030201u), "RGBA() must match FB_FORMAT");
+
+// Palette for indexed surfaces. Colours get an index the first time they are drawn
+// (the game uses a few dozen constants); once all 256 are taken, new colours map to
+// the nearest entry. lut expands indices back to FB_FORMAT.
+struct Palette {
+    uint32_t lut[256] = {};
+    int count = 0;
+    uint32_t keys[1024] = {};   // open-addressed colour -> index cache
+    uint8_t vals[1024] = {};
+    bool used[1024] = {};
+    int cached = 0;
+    uint32_t lastColor = 0;     // primitives repeat one colour, so check it first
+    uint8_t lastIndex = 0;
+    bool hasLast = false;
+};
+static Palette g_palette;
+
+static uint8_t palIndex(uint32_t c) {
+    Palette& P = g_palette;
+    if (P.hasLast && P.lastColor == c) return P.lastIndex;
+    uint32_t slot = (c * 2654435761u) >> 22;
+    while (P.used[slot] && P.keys[slot] != c) slot = (slot + 1) & 1023;
+    uint8_t i;
+    if (P.used[slot]) i = P.vals[slot];
+    else {
+        if (P.count < 256) { i = uint8_t(P.count); P.lut[P.count++] = c; }
+        else {
+            int best = 0, bestD = INT32_MAX;
+            for (int k = 0; k < 256; ++k) {
+                int dr = pxR(c) - pxR(P.lut[k]), dg = pxG(c) - pxG(P.lut[k]), db = pxB(c) - pxB(P.lut[k]);
+                int d = dr * dr + dg * dg + db * db;
+                if (d < bestD) { bestD = d; best = k; }
+            }
+            i = uint8_t(best);
+        }
+        if (P.cached < 512) { P.used[slot] = true; P.keys[slot] = c; P.vals[slot] = i; ++P.cached; } // keep probes short
+    }
+    P.lastColor = c; P.lastIndex = i; P.hasLast = true;
+    return i;
 }
+
 static void clear(uint32_t color) {
-    uint32_t* px = (uint32_t*)g_pixels;
-    std::fill(px, px + WIDTH * HEIGHT, color);
+    Surface& T = *g_target;
+    size_t a = size_t(T.top) * T.w, b = size_t(T.h) * T.w;
+    if (T.idx) { memset(T.idx + a, palIndex(color), b - a); return; }
+    std::fill(T.px + a, T.px + b, color);
 }
 static void putpx(int x, int y, uint32_t c) {
-    if ((unsigned)x < (unsigned)WIDTH && (unsigned)y < (unsigned)HEIGHT)
-        ((uint32_t*)g_pixels)[y * WIDTH + x] = c;
+    if ((unsigned)x < (unsigned)g_target->w && y >= g_target->top && y < g_target->h) {
+        if (g_target->idx) g_target->idx[y * g_target->w + x] = palIndex(c);
+        else g_target->px[y * g_target->w + x] = c;
+    }
 }
 static void fillRect(int x, int y, int w, int h, uint32_t c) {
-    int x0 = std::max(0, x), y0 = std::max(0, y);
-    int x1 = std::min(WIDTH, x + w), y1 = std::min(HEIGHT, y + h);
+    int x0 = std::max(0, x), y0 = std::max(g_target->top, y);
+    int x1 = std::min(g_target->w, x + w), y1 = std::min(g_target->h, y + h);
+    if (x1 <= x0) return;
+    if (g_target->idx) {
+        uint8_t i = palIndex(c);
+        for (int j = y0; j < y1; ++j) memset(g_target->idx + j * g_target->w + x0, i, size_t(x1 - x0));
+        return;
+    }
     for (int j = y0; j < y1; ++j) {
-        uint32_t* row = ((uint32_t*)g_pixels) + j * WIDTH;
+        uint32_t* row = g_target->px + j * g_target->w;
         for (int i = x0; i < x1; ++i) row[i] = c;
     }
 }
+// Span primitives: each clips its extent once and then writes whole row spans or
+// columns, never testing single pixels.
+static void hspan(int x0, int x1, int y, uint32_t c) { fillRect(x0, y, x1 - x0, 1, c); } // [x0, x1)
+static void vspan(int x, int y0, int y1, uint32_t c) {                                    // [y0, y1)
+    Surface& T = *g_target;
+    if ((unsigned)x >= (unsigned)T.w) return;
+    y0 = std::max(y0, T.top); y1 = std::min(y1, T.h);
+    if (y0 >= y1) return;
+    if (T.idx) { uint8_t i = palIndex(c); for (int y = y0; y < y1; ++y) T.idx[size_t(y) * T.w + x] = i; }
+    else for (int y = y0; y < y1; ++y) T.px[size_t(y) * T.w + x] = c;
+}
+// Outline as two row spans and two columns between them; every pixel written once.
 static void drawRect(int x, int y, int w, int h, uint32_t c) {
-    for (int i = x; i < x + w; ++i) { putpx(i, y, c); putpx(i, y + h - 1, c); }
-    for (int j = y; j < y + h; ++j) { putpx(x, j, c); putpx(x + w - 1, j, c); }
+    if (w <= 0 || h <= 0) return;
+    hspan(x, x + w, y, c);
+    if (h > 1) hspan(x, x + w, y + h - 1, c);
+    if (h > 2) {
+        vspan(x, y + 1, y + h - 1, c);
+        if (w > 1) vspan(x + w - 1, y + 1, y + h - 1, c);
+    }
 }
+// One span per row; the half-width shrinks as rows move away from the centre.
 static void fillCircle(int cx, int cy, int r, uint32_t c) {
     int r2 = r * r;
-    int y = r;
-    for (int x = 0; x <= r; ++x) {
-        while (y * y + x * x > r2) --y;
-        for (int i = cx - x; i <= cx + x; ++i) { putpx(i, cy + y, c); putpx(i, cy - y, c); }
+    int x = r;
+    for (int y = 0; y <= r; ++y) {
+        while (x * x + y * y > r2) --x;
+        fillRect(cx - x, cy + y, 2 * x + 1, 1, c);
+        if (y) fillRect(cx - x, cy - y, 2 * x + 1, 1, c);
+    }
+}
+// Bresenham line with both endpoints. A line inside the target steps a pointer with no
+// tests; one crossing an edge gathers the pixels on each row (x-major) or column
+// (y-major) into a run and writes it as a clipped span.
+static void drawLine(int x0, int y0, int x1, int y1, uint32_t c) {
+    const Surface& T = *g_target;
+    if (std::max(x0, x1) < 0 || std::min(x0, x1) >= T.w || std::max(y0, y1) < T.top || std::min(y0, y1) >= T.h) return;
+    int dx = std::abs(x1 - x0), dy = std::abs(y1 - y0), sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+    int err = dx - dy;
+    if (!T.idx && std::min(x0, x1) >= 0 && std::max(x0, x1) < T.w && std::min(y0, y1) >= T.top && std::max(y0, y1) < T.h) {
+        uint32_t* p = T.px + size_t(y0) * T.w + x0;
+        ptrdiff_t stepY = sy * ptrdiff_t(T.w);
+        for (int n = std::max(dx, dy); ; --n) {
+            *p = c;
+            if (!n) return;
+            int e2 = 2 * err;
+            if (e2 > -dy) { err -= dy; p += sx; }
+            if (e2 < dx) { err += dx; p += stepY; }
+        }
+    }
+    bool xMajor = dx >= dy;
+    int rx = x0, ry = y0; // run start
+    for (;;) {
+        bool last = x0 == x1 && y0 == y1;
+        int e2 = 2 * err, nx = x0, ny = y0;
+        if (!last) {
+            if (e2 > -dy) { err -= dy; nx += sx; }
+            if (e2 < dx) { err += dx; ny += sy; }
+        }
+        if (last || (xMajor ? ny != ry : nx != rx)) { // the run ends at (x0, y0)
+            if (xMajor) hspan(std::min(rx, x0), std::max(rx, x0) + 1, ry, c);
+            else vspan(rx, std::min(ry, y0), std::max(ry, y0) + 1, c);
+            rx = nx; ry = ny;
+        }
+        if (last) return;
+        x0 = nx; y0 = ny;
     }
 }
+// x where the edge (xa, ya)-(xb, yb) crosses row centre yc.
+static inline float edgeX(float xa, float ya, float xb, float yb, float yc) { return xa + (yc - ya) * (xb - xa) / (yb - ya); }
+// Even-odd scanline fill of the polygon xy[0..2n): a pixel is set when its centre is
+// inside. Edges own their top end but not their bottom end, so shared vertices and
+// abutting polygons don't double up.
+static void fillPolygon(const float* xy, int n, uint32_t c) {
+    if (n < 3) return;
+    float ymin = xy[1], ymax = xy[1];
+    for (int i = 1; i < n; ++i) { ymin = std::min(ymin, xy[i * 2 + 1]); ymax = std::max(ymax, xy[i * 2 + 1]); }
+    int y0 = std::max(g_target->top, int(std::ceil(ymin - 0.5f))), y1 = std::min(g_target->h, int(std::ceil(ymax - 0.5f)));
+    static thread_local std::vector<float> xs;
+    for (int y = y0; y < y1; ++y) {
+        float yc = y + 0.5f;
+        xs.clear();
+        for (int i = 0, j = n - 1; i < n; j = i++) {
+            float xa = xy[j * 2], ya = xy[j * 2 + 1], xb = xy[i * 2], yb = xy[i * 2 + 1];
+            if ((ya <= yc) != (yb <= yc)) xs.push_back(edgeX(xa, ya, xb, yb, yc));
+        }
+        std::sort(xs.begin(), xs.end());
+        for (size_t k = 0; k + 1 < xs.size(); k += 2)
+            hspan(int(std::ceil(xs[k] - 0.5f)), int(std::ceil(xs[k + 1] - 0.5f)), y, c);
+    }
+}
+// Segment of the given width with square ends, filled as a quad.
+static void drawThickLine(float x0, float y0, float x1, float y1, float width, uint32_t c) {
+    float dx = x1 - x0, dy = y1 - y0, len = std::sqrt(dx * dx + dy * dy);
+    if (len <= 0.f) return;
+    float nx = -dy / len * width * 0.5f, ny = dx / len * width * 0.5f;
+    float q[8] = { x0 + nx, y0 + ny, x1 + nx, y1 + ny, x1 - nx, y1 - ny, x0 - nx, y0 - ny };
+    fillPolygon(q, 4, c);
+}
 template<typename T> static T clamp(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
 
+// Anti-aliased disc with a float centre and radius, in continuous pixel coordinates
+// (pixel i spans [i, i+1)). Coverage is approximated by clamp(r + 0.5 - distance from the
+// pixel centre, 0, 1): per row only the pixels within half a pixel of the edge are
+// blended, 4 at a time with SSE2, and the run between them is filled solid. Edge groups
+// may run past their band into pixels that get coverage 0 or are filled afterwards.
+// dst + (c - dst) * cov per channel for 4 pixels, with cov quantized to 1/512.
+static inline void blendCoverage4(uint32_t* dst, __m128 cov, __m128i c16) {
+    __m128i a = _mm_cvtps_epi32(_mm_mul_ps(cov, _mm_set1_ps(512.f)));
+    a = _mm_packs_epi32(a, a);
+    a = _mm_unpacklo_epi16(a, a); // a0 a0 a1 a1 a2 a2 a3 a3
+    __m128i aLo = _mm_unpacklo_epi32(a, a), aHi = _mm_unpackhi_epi32(a, a);
+    __m128i d = _mm_loadu_si128((const __m128i*)dst), z = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(d, z), hi = _mm_unpackhi_epi8(d, z);
+    // ((c - d) << 7) * a >> 16 == (c - d) * a / 512, and stays within 16 bits
+    lo = _mm_add_epi16(lo, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(c16, lo), 7), aLo));
+    hi = _mm_add_epi16(hi, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(c16, hi), 7), aHi));
+    _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+}
+static inline void blendCoverage1(uint32_t* dst, float cov, uint32_t c) {
+    int a = int(cov * 512.f + 0.5f);
+    uint32_t d = *dst, out = 0;
+    for (int k = 0; k < 32; k += 8) {
+        int dc = (d >> k) & 255, cc = (c >> k) & 255;
+        out |= uint32_t(dc + ((((cc - dc) * 128) * a) >> 16)) << k;
+    }
+    *dst = out;
+}
+static void fillCircleAA(float cx, float cy, float r, uint32_t c) {
+    if (r <= 0) return;
+    Surface& T = *g_target;
+    if (T.idx) { // coverage blending needs true colour: hard edges on indexed targets
+        fillCircle(int(std::floor(cx)), int(std::floor(cy)), int(r + 0.5f), c);
+        return;
+    }
+    float ro = r + 0.5f, ri = r - 0.5f;
+    int y0 = std::max(T.top, int(std::floor(cy - ro))), y1 = std::min(T.h, int(std::ceil(cy + ro)));
+    __m128i c16 = _mm_unpacklo_epi8(_mm_set1_epi32(int(c)), _mm_setzero_si128());
+    __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), vro = _mm_set1_ps(ro);
+    for (int y = y0; y < y1; ++y) {
+        float dy = y + 0.5f - cy, dy2 = dy * dy;
+        if (dy2 >= ro * ro) continue;
+        uint32_t* row = T.px + size_t(y) * T.w;
+        auto edge = [&](int x0, int x1, int limit) { // groups of 4 may write up to limit
+            __m128 vdy2 = _mm_set1_ps(dy2);
+            int x = x0;
+            for (; x < x1 && x + 4 <= limit; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps(x - cx), lanes);
+                __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(px, px), vdy2));
+                __m128 cov = _mm_min_ps(_mm_max_ps(_mm_sub_ps(vro, dist), _mm_setzero_ps()), _mm_set1_ps(1.f));
+                blendCoverage4(row + x, cov, c16);
+            }
+            for (; x < x1; ++x) {
+                float px = x + 0.5f - cx;
+                blendCoverage1(row + x, clamp(ro - std::sqrt(px * px + dy2), 0.f, 1.f), c);
+            }
+        };
+        float ho = std::sqrt(ro * ro - dy2);
+        int xo0 = std::max(0, int(std::floor(cx - ho))), xo1 = std::min(T.w, int(std::ceil(cx + ho)));
+        if (xo1 <= xo0) continue;
+        int xi0 = xo1, xi1 = xo1; // fully covered pixels: centre within ri
+        if (ri > 0 && dy2 < ri * ri) {
+            float hi = std::sqrt(ri * ri - dy2);
+            xi0 = clamp(int(std::ceil(cx - hi - 0.5f)), xo0, xo1);
+            xi1 = clamp(int(std::floor(cx + hi - 0.5f)) + 1, xi0, xo1);
+        }
+        if (xi0 == xi1) { edge(xo0, xo1, T.w); continue; }
+        edge(xo0, xi0, xi1);
+        std::fill(row + xi0, row + xi1, c);
+        edge(xi1, xo1, T.w);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Pixel conversion: whole rows of framebuffer pixels into the layout a presenter or
+// encoder wants, 4-8 pixels per step with SSE2 (SSSE3 for packed RGB8 when the build
+// targets it), and PAL8 expansion through a 256-entry LUT.
+// ---------------------------------------------------------------------------
+static inline uint32_t swapRB(uint32_t p) { return (p & 0xFF00FF00u) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16); }
+static inline __m128i swapRB4(__m128i p) {
+    const __m128i ag = _mm_set1_epi32(int(0xFF00FF00u)), lo = _mm_set1_epi32(0xFF);
+    return _mm_or_si128(_mm_and_si128(p, ag), _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), lo), _mm_slli_epi32(_mm_and_si128(p, lo), 16)));
+}
+static inline uint16_t toRgb565(uint32_t p) { return uint16_t((pxR(p) >> 3) << 11 | (pxG(p) >> 2) << 5 | pxB(p) >> 3); }
+// 4 pixels as RGB565 in the low 16 bits of each lane, minus 0x8000 so a signed pack
+// cannot saturate.
+static inline __m128i rgb565Biased4(__m128i p) {
+    const __m128i m5 = _mm_set1_epi32(0x1F), m6 = _mm_set1_epi32(0x3F);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, FB_SHIFT_R + 3), m5);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 10), m6);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, FB_SHIFT_B + 3), m5);
+    __m128i v = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 11), _mm_slli_epi32(g, 5)), b);
+    return _mm_sub_epi32(v, _mm_set1_epi32(0x8000));
+}
+
+// Writes n framebuffer pixels to dst as `to` (PIXEL_BYTES per pixel, any alignment).
+// PAL8 needs a palette search and is not a target; indexed pixels only expand.
+static void convertPixels(const uint32_t* src, void* dst, size_t n, PixelFormat to) {
+    size_t i = 0;
+    uint8_t* d = (uint8_t*)dst;
+    switch (to) {
+    case PixelFormat::BGRA8:
+    case PixelFormat::RGBA8:
+        if (to == FB_FORMAT) { memcpy(d, src, n * 4); return; }
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_si128((__m128i*)(d + i * 4), swapRB4(_mm_loadu_si128((const __m128i*)(src + i))));
+        for (; i < n; ++i) { uint32_t v = swapRB(src[i]); memcpy(d + i * 4, &v, 4); }
+        return;
+    case PixelFormat::RGB565: {
+        const __m128i bias = _mm_set1_epi16(short(0x8000));
+        for (; i + 8 <= n; i += 8) {
+            __m128i a = rgb565Biased4(_mm_loadu_si128((const __m128i*)(src + i)));
+            __m128i b = rgb565Biased4(_mm_loadu_si128((const __m128i*)(src + i + 4)));
+            _mm_storeu_si128((__m128i*)(d + i * 2), _mm_xor_si128(_mm_packs_epi32(a, b), bias));
+        }
+        for (; i < n; ++i) { uint16_t v = toRgb565(src[i]); memcpy(d + i * 2, &v, 2); }
+        return;
+    }
+    case PixelFormat::RGB8:
+#ifdef __SSSE3__
+        {
+            const __m128i shuf = FB_FORMAT == PixelFormat::BGRA8
+                ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+                : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            // 12 bytes per 4 pixels but a 16-byte store: stop while the tail can absorb it
+            for (; i + 6 <= n; i += 4)
+                _mm_storeu_si128((__m128i*)(d + i * 3), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuf));
+        }
+#endif
+        for (; i < n; ++i) { d[i * 3] = uint8_t(pxR(src[i])); d[i * 3 + 1] = uint8_t(pxG(src[i])); d[i * 3 + 2] = uint8_t(pxB(src[i])); }
+        return;
+    case PixelFormat::PAL8:
+    case PixelFormat::COUNT:
+        break;
+    }
+}
+
+// Indexed pixels to 32-bit through lut; AVX2 builds gather 8 entries per step.
+static void expandPal8(const uint8_t* src, uint32_t* dst, size_t n, const uint32_t* lut) {
+    size_t i = 0;
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*)lut, idx, 4));
+    }
+#endif
+    for (; i + 4 <= n; i += 4) {
+        uint32_t q;
+        memcpy(&q, src + i, 4);
+        dst[i] = lut[q & 255]; dst[i + 1] = lut[(q >> 8) & 255];
+        dst[i + 2] = lut[(q >> 16) & 255]; dst[i + 3] = lut[q >> 24];
+    }
+    for (; i < n; ++i) dst[i] = lut[src[i]];
+}
+
+// Simulation scalar. Floats can round differently across compilers (FMA contraction,
+// x87 vs SSE), which breaks lockstep and replays between machines. ISAAC_FIXED_MATH
+// swaps in Q16.16 fixed point held in 64 bits, where every operation, including
+// sqrt, is exact integer arithmetic. Products are fine for game-sized values
+// (|a|, |b| < 32768); squared distances across the screen (~1e6) still fit.
+#ifdef ISAAC_FIXED_MATH
+struct Fixed {
+    static const int FRAC = 16;
+    int64_t raw = 0;
+    Fixed() = default;
+    constexpr Fixed(int v) : raw(int64_t(v) << FRAC) {}
+    constexpr Fixed(float v) : raw(int64_t(v * float(1 << FRAC) + (v < 0 ? -0.5f : 0.5f))) {}
+    constexpr Fixed(double v) : raw(int64_t(v * double(1 << FRAC) + (v < 0 ? -0.5 : 0.5))) {}
+    static constexpr Fixed fromRaw(int64_t r) { Fixed f; f.raw = r; return f; }
+    explicit operator float() const { return float(raw) / float(1 << FRAC); }
+    explicit operator int() const { return int(raw >> FRAC); } // floor
+    friend Fixed operator+(Fixed a, Fixed b) { return fromRaw(a.raw + b.raw); }
+    friend Fixed operator-(Fixed a, Fixed b) { return fromRaw(a.raw - b.raw); }
+    friend Fixed operator*(Fixed a, Fixed b) { return fromRaw((a.raw * b.raw) >> FRAC); }
+    friend Fixed operator/(Fixed a, Fixed b) { return fromRaw((a.raw * (int64_t(1) << FRAC)) / b.raw); }
+    Fixed operator-() const { return fromRaw(-raw); }
+    Fixed& operator+=(Fixed o) { raw += o.raw; return *this; }
+    Fixed& operator-=(Fixed o) { raw -= o.raw; return *this; }
+    Fixed& operator*=(Fixed o) { return *this = *this * o; }
+    friend bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+    friend bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+    friend bool operator<=(Fixed a, Fixed b) { return a.raw <= b.raw; }
+    friend bool operator>=(Fixed a, Fixed b) { return a.raw >= b.raw; }
+    friend bool operator==(Fixed a, Fixed b) { return a.raw == b.raw; }
+    friend bool operator!=(Fixed a, Fixed b) { return a.raw != b.raw; }
+};
+using Scalar = Fixed;
+static Fixed ssqrt(Fixed a) { // bit-by-bit integer sqrt of raw << FRAC
+    if (a.raw <= 0) return Fixed(0);
+    uint64_t v = uint64_t(a.raw) << Fixed::FRAC, r = 0, bit = uint64_t(1) << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) { v -= r + bit; r = (r >> 1) + bit; }
+        else r >>= 1;
+        bit >>= 2;
+    }
+    return Fixed::fromRaw(int64_t(r));
+}
+static Fixed sabs(Fixed a) { return a.raw < 0 ? -a : a; }
+static uint64_t scalarBits(Fixed a) { return uint64_t(a.raw); }
+static const char* SCALAR_NAME = "fixed Q16.16";
+#else
+using Scalar = float;
+static float ssqrt(float a) { return std::sqrt(a); }
+static float sabs(float a) { return std::fabs(a); }
+static uint64_t scalarBits(float a) { uint32_t u; memcpy(&u, &a, 4); return u; }
+static const char* SCALAR_NAME = "float";
+#endif
+
+// Draws are written out explicitly (not with <random> distributions, whose output
+// differs between standard libraries) so a seed reproduces the same floor anywhere.
 struct RNG {
     std::mt19937_64 eng;
     RNG() : eng(std::random_device{}()) {}
-    int  randint(int a, int b) { std::uniform_int_distribution<int> d(a, b); return d(eng); }
-    float randf(float a, float b) { std::uniform_real_distribution<float> d(a, b); return d(eng); }
-    bool  chance(float p) { std::bernoulli_distribution d(p); return d(eng); }
+    explicit RNG(uint64_t seed) : eng(seed) {}
+    int  randint(int a, int b) { return a + int(eng() % uint64_t(int64_t(b) - a + 1)); }
+    Scalar randf(Scalar a, Scalar b) {
+        uint64_t u = eng() >> 40; // 24 bits
+#ifdef ISAAC_FIXED_MATH
+        return Fixed::fromRaw(a.raw + int64_t((uint64_t(b.raw - a.raw) * u) >> 24));
+#else
+        return a + (b - a) * (float(u) * (1.0f / 16777216.0f));
+#endif
+    }
+    bool  chance(float p) { return (eng() >> 40) < uint64_t(p * 16777216.0f); }
+    template<typename It> void shuffle(It first, It last) { // Fisher-Yates
+        for (auto n = last - first; n > 1; --n) std::swap(first[n - 1], first[randint(0, int(n - 1))]);
+    }
 };
 
 struct Vec {
-    float x = 0, y = 0;
-    Vec() = default; Vec(float X, float Y) :x(X), y(Y) {}
+    Scalar x = 0, y = 0;
+    Vec() = default; Vec(Scalar X, Scalar Y) :x(X), y(Y) {}
     Vec operator+(const Vec& o) const { return { x + o.x,y + o.y }; }
     Vec operator-(const Vec& o) const { return { x - o.x,y - o.y }; }
-    Vec operator*(float s) const { return { x * s,y * s }; }
+    Vec operator*(Scalar s) const { return { x * s,y * s }; }
     Vec& operator+=(const Vec& o) { x += o.x; y += o.y; return *this; }
 };
-static float dot(const Vec& a, const Vec& b) { return a.x * b.x + a.y * b.y; }
-static float len(const Vec& a) { return std::sqrt(dot(a, a)); }
-static Vec norm(const Vec& a) { float L = len(a); return L > 0 ? a * (1.0f / L) : Vec(0, 0); }
+static Scalar dot(const Vec& a, const Vec& b) { return a.x * b.x + a.y * b.y; }
+static Scalar len(const Vec& a) { return ssqrt(dot(a, a)); }
+static Vec norm(const Vec& a) { Scalar L = len(a); return L > 0 ? Vec(a.x / L, a.y / L) : Vec(0, 0); }
+
+// ---------------------------------------------------------------------------
+// Batch vector math: float lanes over structure-of-arrays data, for updating many
+// entities per call. Vec8f is one AVX register when compiled with AVX, otherwise
+// a pair of SSE Vec4f. Comparisons return all-ones/all-zero lane masks for select().
+// ---------------------------------------------------------------------------
+struct Vec4f {
+    __m128 v;
+    Vec4f() = default;
+    Vec4f(__m128 x) : v(x) {}
+    explicit Vec4f(float s) : v(_mm_set1_ps(s)) {}
+    static Vec4f load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    friend Vec4f operator+(Vec4f a, Vec4f b) { return _mm_add_ps(a.v, b.v); }
+    friend Vec4f operator-(Vec4f a, Vec4f b) { return _mm_sub_ps(a.v, b.v); }
+    friend Vec4f operator*(Vec4f a, Vec4f b) { return _mm_mul_ps(a.v, b.v); }
+    friend Vec4f operator<(Vec4f a, Vec4f b) { return _mm_cmplt_ps(a.v, b.v); }
+    friend Vec4f operator>(Vec4f a, Vec4f b) { return _mm_cmpgt_ps(a.v, b.v); }
+};
+static Vec4f select(Vec4f mask, Vec4f a, Vec4f b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+static Vec4f rsqrtNR(Vec4f x) { // ~12-bit estimate refined by one Newton step to ~22 bits
+    Vec4f y = _mm_rsqrt_ps(x.v);
+    return y * (Vec4f(1.5f) - Vec4f(0.5f) * x * y * y);
+}
+
+#ifdef __AVX__
+struct Vec8f {
+    __m256 v;
+    Vec8f() = default;
+    Vec8f(__m256 x) : v(x) {}
+    explicit Vec8f(float s) : v(_mm256_set1_ps(s)) {}
+    static Vec8f load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+    friend Vec8f operator+(Vec8f a, Vec8f b) { return _mm256_add_ps(a.v, b.v); }
+    friend Vec8f operator-(Vec8f a, Vec8f b) { return _mm256_sub_ps(a.v, b.v); }
+    friend Vec8f operator*(Vec8f a, Vec8f b) { return _mm256_mul_ps(a.v, b.v); }
+    friend Vec8f operator<(Vec8f a, Vec8f b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    friend Vec8f operator>(Vec8f a, Vec8f b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+};
+static Vec8f select(Vec8f mask, Vec8f a, Vec8f b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+static Vec8f rsqrtNR(Vec8f x) {
+    Vec8f y = _mm256_rsqrt_ps(x.v);
+    return y * (Vec8f(1.5f) - Vec8f(0.5f) * x * y * y);
+}
+static const char* VEC8_NAME = "AVX, 8 lanes";
+#else
+struct Vec8f {
+    Vec4f lo, hi;
+    Vec8f() = default;
+    Vec8f(Vec4f a, Vec4f b) : lo(a), hi(b) {}
+    explicit Vec8f(float s) : lo(s), hi(s) {}
+    static Vec8f load(const float* p) { return { Vec4f::load(p), Vec4f::load(p + 4) }; }
+    void store(float* p) const { lo.store(p); hi.store(p + 4); }
+    friend Vec8f operator+(Vec8f a, Vec8f b) { return { a.lo + b.lo, a.hi + b.hi }; }
+    friend Vec8f operator-(Vec8f a, Vec8f b) { return { a.lo - b.lo, a.hi - b.hi }; }
+    friend Vec8f operator*(Vec8f a, Vec8f b) { return { a.lo * b.lo, a.hi * b.hi }; }
+    friend Vec8f operator<(Vec8f a, Vec8f b) { return { a.lo < b.lo, a.hi < b.hi }; }
+    friend Vec8f operator>(Vec8f a, Vec8f b) { return { a.lo > b.lo, a.hi > b.hi }; }
+};
+static Vec8f select(Vec8f mask, Vec8f a, Vec8f b) { return { select(mask.lo, a.lo, b.lo), select(mask.hi, a.hi, b.hi) }; }
+static Vec8f rsqrtNR(Vec8f x) { return { rsqrtNR(x.lo), rsqrtNR(x.hi) }; }
+static const char* VEC8_NAME = "SSE, 2x4 lanes";
+#endif
+
+// One group of lanes for the batch functions below. They run groups of 8, then one of 4,
+// then scalars: a room holds 2-6 enemies, so enemy steering only ever takes the 4-lane
+// group (rooms of 4 or more) and the scalar tail.
+template<typename V> static void lengthLanes(const float* x, const float* y, float* out) {
+    V X = V::load(x), Y = V::load(y);
+    V l2 = X * X + Y * Y;
+    select(l2 > V(0.f), l2 * rsqrtNR(l2), V(0.f)).store(out);
+}
+template<typename V> static void normalizeLanes(float* x, float* y, float* lenOut) {
+    V X = V::load(x), Y = V::load(y);
+    V l2 = X * X + Y * Y;
+    V inv = select(l2 > V(0.f), rsqrtNR(l2), V(0.f));
+    (X * inv).store(x);
+    (Y * inv).store(y);
+    if (lenOut) (l2 * inv).store(lenOut);
+}
+
+// out[i] = |(x[i], y[i])|
+static void batchLength(const float* x, const float* y, float* out, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) lengthLanes<Vec8f>(x + i, y + i, out + i);
+    if (i + 4 <= n) { lengthLanes<Vec4f>(x + i, y + i, out + i); i += 4; }
+    for (; i < n; ++i) out[i] = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+}
+// Normalizes (x[i], y[i]) in place; zero vectors stay zero. lenOut (optional)
+// receives the lengths, which come for free from the same reciprocal sqrt.
+static void batchNormalize(float* x, float* y, float* lenOut, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) normalizeLanes<Vec8f>(x + i, y + i, lenOut ? lenOut + i : nullptr);
+    if (i + 4 <= n) { normalizeLanes<Vec4f>(x + i, y + i, lenOut ? lenOut + i : nullptr); i += 4; }
+    for (; i < n; ++i) {
+        float L = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+        if (L > 0) { x[i] /= L; y[i] /= L; }
+        if (lenOut) lenOut[i] = L;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Audio: a fixed pool of voices mixed in software on a dedicated thread.
+// The game thread only pushes commands into a lock-free queue; the audio thread
+// drains it, mixes with SSE2 and hands each block to a sink (waveOut device, WAV
+// file or null). Nothing on the audio thread allocates.
+// ---------------------------------------------------------------------------
+static const int AUDIO_RATE = 44100;
+static const int AUDIO_BLOCK = 512;   // stereo frames per mix call, multiple of 4
+static const int AUDIO_BUFFERS = 4;   // blocks queued on the device
+static const int MAX_VOICES = 256;
+
+static double nowSeconds() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+// User + kernel CPU time of the whole process (all threads).
+static double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+    auto secs = [](const FILETIME& f) { return (uint64_t(f.dwHighDateTime) << 32 | f.dwLowDateTime) * 1e-7; };
+    return secs(kernel) + secs(user);
+#else
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+// Single-producer/single-consumer ring. N must be a power of two.
+template<typename T, uint32_t N> struct SpscQueue {
+    static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+    std::array<T, N> items{};
+    std::atomic<uint32_t> head{ 0 }, tail{ 0 };
+    bool push(const T& v) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) return false;
+        items[t & (N - 1)] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T& v) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        v = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    size_t k = std::min(v.size() - 1, size_t(p * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+// Latency samples: count, mean and max over everything, percentiles over the last
+// WINDOW. Fixed size, so it can run for as long as the game does.
+struct LatencyStats {
+    static const int WINDOW = 1024;
+    double last[WINDOW] = {};
+    uint64_t n = 0;
+    double sum = 0, max = 0;
+    void add(double v) { last[n % WINDOW] = v; ++n; sum += v; max = std::max(max, v); }
+    double mean() const { return n ? sum / double(n) : 0.0; }
+    double pct(double p) const { return percentile(std::vector<double>(last, last + std::min<uint64_t>(n, WINDOW)), p); }
+};
+
+// ---------------------------------------------------------------------------
+// Profiler zones. A ProfZone times the rest of its scope into one zone and, with
+// counters open (Linux perf_event_open), also adds the cycles, instructions, cache
+// misses and branch misses the game thread spent there: one counter group, read in a
+// single syscall at entry and exit. Zones are aggregated per frame (profFrame) and
+// carry an entity count, so misses can be reported per enemy, shot or command. Work
+// the job pool fans out to other threads shows in the times but not the counters.
+// Without perf_event_open (other systems, perf_event_paranoid, VMs without a PMU)
+// only times are kept.
+// ---------------------------------------------------------------------------
+enum ProfZoneId { PZ_ENEMIES, PZ_BULLETS, PZ_HITS, PZ_DRAWLIST, PZ_LIGHT, PZ_HUD, PZ_POST, PZ_COUNT };
+static const char* PZ_NAMES[PZ_COUNT] = { "updateEnemies", "updateBullets", "playerHitCheck",
+    "drawListFlush", "lightApply", "drawHUD", "postProcess" };
+static const char* PZ_ENTITY[PZ_COUNT] = { "enemy", "shot", "enemy", "cmd", "light", "frame", "row" };
+static const char* PZ_ENTITIES[PZ_COUNT] = { "enemies", "shots", "enemies", "cmds", "lights", "frames", "rows" };
+enum { PC_CYCLES, PC_INSTRUCTIONS, PC_CACHE_MISSES, PC_BRANCH_MISSES, PC_COUNT };
+
+struct ProfZoneStats {
+    uint64_t calls = 0, entities = 0;
+    double sec = 0;
+    uint64_t ctr[PC_COUNT] = {};
+};
+struct Profiler {
+    bool on = false;
+    bool counters = false;
+    int fd[PC_COUNT] = { -1, -1, -1, -1 }; // fd[0] leads the group
+    uint64_t frames = 0;
+    ProfZoneStats zone[PZ_COUNT];
+};
+static Profiler g_prof;
+
+// Current counter values in PC_ order; false when they cannot be read.
+static bool profRead(uint64_t* v) {
+#ifdef ISAAC_PERF_EVENTS
+    uint64_t buf[1 + PC_COUNT];
+    if (read(g_prof.fd[0], buf, sizeof(buf)) != ssize_t(sizeof(buf)) || buf[0] != PC_COUNT) return false;
+    memcpy(v, buf + 1, sizeof(uint64_t) * PC_COUNT);
+    return true;
+#else
+    (void)v;
+    return false;
+#endif
+}
+
+static void profCloseCounters() {
+#ifdef ISAAC_PERF_EVENTS
+    for (int& f : g_prof.fd) if (f >= 0) { close(f); f = -1; }
+#endif
+    g_prof.counters = false;
+}
+
+// Opens the counter group for the calling thread; prints why not when it cannot.
+static bool profOpenCounters() {
+#ifdef ISAAC_PERF_EVENTS
+    static const uint64_t CONFIG[PC_COUNT] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+    for (int i = 0; i < PC_COUNT; ++i) {
+        perf_event_attr a;
+        memset(&a, 0, sizeof(a));
+        a.size = sizeof(a);
+        a.type = PERF_TYPE_HARDWARE;
+        a.config = CONFIG[i];
+        a.disabled = i == 0;
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        a.read_format = PERF_FORMAT_GROUP;
+        g_prof.fd[i] = int(syscall(__NR_perf_event_open, &a, 0, -1, i == 0 ? -1 : g_prof.fd[0], 0));
+        if (g_prof.fd[i] < 0) {
+            printf("profile: perf_event_open failed (%s), zones keep times only\n", strerror(errno));
+            profCloseCounters();
+            return false;
+        }
+    }
+    ioctl(g_prof.fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(g_prof.fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t v[PC_COUNT];
+    if (!profRead(v)) {
+        printf("profile: counter group cannot be read, zones keep times only\n");
+        profCloseCounters();
+        return false;
+    }
+    g_prof.counters = true;
+    return true;
+#else
+    printf("profile: no hardware counters on this system, zones keep times only\n");
+    return false;
+#endif
+}
+
+static void profStart(bool counters) {
+    Profiler& P = g_prof;
+    for (ProfZoneStats& z : P.zone) z = ProfZoneStats{};
+    P.frames = 0;
+    P.on = true;
+    if (counters && !P.counters) profOpenCounters();
+}
+static void profStop() {
+    g_prof.on = false;
+    profCloseCounters();
+}
+static void profFrame() { if (g_prof.on) ++g_prof.frames; }
+
+struct ProfZone {
+    int id = -1;
+    double t0 = 0;
+    uint64_t c0[PC_COUNT] = {};
+    bool ctr = false;
+    ProfZone(int zone, size_t entities) {
+        if (!g_prof.on) return;
+        id = zone;
+        g_prof.zone[id].entities += entities;
+        ctr = g_prof.counters && profRead(c0);
+        t0 = nowSeconds();
+    }
+    ~ProfZone() {
+        if (id < 0) return;
+        ProfZoneStats& z = g_prof.zone[id];
+        z.sec += nowSeconds() - t0;
+        ++z.calls;
+        uint64_t c1[PC_COUNT];
+        if (ctr && profRead(c1)) for (int i = 0; i < PC_COUNT; ++i) z.ctr[i] += c1[i] - c0[i];
+    }
+    ProfZone(const ProfZone&) = delete;
+    ProfZone& operator=(const ProfZone&) = delete;
+};
+
+static void profReport() {
+    const Profiler& P = g_prof;
+    double fr = double(std::max<uint64_t>(P.frames, 1));
+    printf("profile: %llu frames, counters %s\n", (unsigned long long)P.frames, P.counters ? "on" : "off");
+    for (int i = 0; i < PZ_COUNT; ++i) {
+        const ProfZoneStats& z = P.zone[i];
+        if (!z.calls) continue;
+        double ent = double(std::max<uint64_t>(z.entities, 1));
+        printf("profile %-15s %8.1f us/frame, %6.1f %s/frame", PZ_NAMES[i], z.sec * 1e6 / fr, z.entities / fr, PZ_ENTITIES[i]);
+        if (P.counters && z.ctr[PC_CYCLES])
+            printf(", IPC %.2f, %.2f cache misses and %.2f branch misses per %s",
+                double(z.ctr[PC_INSTRUCTIONS]) / double(z.ctr[PC_CYCLES]),
+                z.ctr[PC_CACHE_MISSES] / ent, z.ctr[PC_BRANCH_MISSES] / ent, PZ_ENTITY[i]);
+        printf("\n");
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Metrics registry. The game only does relaxed atomic adds and stores here; the
+// -metrics server thread reads the values when it is scraped (see metricsStart).
+// Gauges are sampled once a frame; frame times go to a small ring the server turns
+// into quantiles. A frame's ring slot is written before M_FRAMES is bumped with
+// release, so a scrape that loads M_FRAMES with acquire sees every slot it counts.
+// ---------------------------------------------------------------------------
+enum MetricId {
+    M_TICKS, M_FRAMES, M_RUNS, M_FLOORS, M_ROOMS_CLEARED, M_SHOTS, M_KILLS, M_ALLOCS, // counters
+    M_ENEMIES, M_BULLETS, M_HP, M_DEPTH,                                              // gauges
+    M_COUNT
+};
+struct MetricInfo { const char* name; const char* type; const char* help; };
+static const MetricInfo METRICS[M_COUNT] = {
+    { "isaac_ticks_total", "counter", "Simulation ticks run." },
+    { "isaac_frames_total", "counter", "Frames rendered." },
+    { "isaac_runs_total", "counter", "Runs started." },
+    { "isaac_floors_descended_total", "counter", "Floors descended in endless mode." },
+    { "isaac_rooms_cleared_total", "counter", "Rooms cleared of enemies." },
+    { "isaac_shots_fired_total", "counter", "Player shots fired." },
+    { "isaac_enemies_killed_total", "counter", "Enemies killed." },
+    { "isaac_allocations_total", "counter", "C++ heap allocations (ISAAC_COUNT_ALLOCS builds)." },
+    { "isaac_enemies_alive", "gauge", "Enemies alive on the current floor." },
+    { "isaac_bullets", "gauge", "Player shots in flight." },
+    { "isaac_player_hp", "gauge", "Player hit points." },
+    { "isaac_floor_depth", "gauge", "Current floor in endless mode." },
+};
+struct Metrics {
+    static const int FRAME_RING = 256;
+    std::atomic<int64_t> v[M_COUNT];
+    std::atomic<uint32_t> frameUs[FRAME_RING];    // newest frame times, by frame number
+    std::atomic<uint64_t> frameSumUs[FRAME_RING]; // total of all frame times up to that frame
+};
+static Metrics g_metrics; // static storage: starts zeroed, before any allocation can count
+
+static void metricAdd(MetricId id, int64_t n = 1) { g_metrics.v[id].fetch_add(n, std::memory_order_relaxed); }
+static void metricSet(MetricId id, int64_t x) { g_metrics.v[id].store(x, std::memory_order_relaxed); }
+// Game thread only: it is the sole writer of M_FRAMES and the ring.
+static void metricFrame(double sec) {
+    const int R = Metrics::FRAME_RING;
+    uint32_t us = uint32_t(std::min(sec * 1e6, 4e9));
+    int64_t n = g_metrics.v[M_FRAMES].load(std::memory_order_relaxed);
+    uint64_t sum = n ? g_metrics.frameSumUs[(n - 1) % R].load(std::memory_order_relaxed) : 0;
+    g_metrics.frameUs[n % R].store(us, std::memory_order_relaxed);
+    g_metrics.frameSumUs[n % R].store(sum + us, std::memory_order_relaxed);
+    g_metrics.v[M_FRAMES].fetch_add(1, std::memory_order_release);
+}
+
+#ifdef ISAAC_COUNT_ALLOCS
+// Every C++ heap allocation, on any thread, bumps isaac_allocations_total. That puts
+// an atomic add on each one, so it is only built in with -DISAAC_COUNT_ALLOCS.
+static const size_t NEW_ALIGN = __STDCPP_DEFAULT_NEW_ALIGNMENT__; // what plain new guarantees
+static void* countedAlloc(size_t n, size_t align) {
+    metricAdd(M_ALLOCS);
+    if (n == 0) n = 1;
+    if (align <= NEW_ALIGN) return malloc(n);
+#ifdef _WIN32
+    return _aligned_malloc(n, align);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, align, n) == 0 ? p : nullptr;
+#endif
+}
+static void* countedNew(size_t n, size_t align) {
+    if (void* p = countedAlloc(n, align)) return p;
+    throw std::bad_alloc();
+}
+// Out of line: GCC inlines the replaced delete into callers and then warns that new'd
+// pointers reach free().
+#ifdef _MSC_VER
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+static void countedFree(void* p, size_t align) {
+#ifdef _WIN32
+    if (align > NEW_ALIGN) { _aligned_free(p); return; }
+#endif
+    (void)align;
+    free(p);
+}
+void* operator new(size_t n) { return countedNew(n, NEW_ALIGN); }
+void* operator new[](size_t n) { return countedNew(n, NEW_ALIGN); }
+void* operator new(size_t n, std::align_val_t a) { return countedNew(n, size_t(a)); }
+void* operator new[](size_t n, std::align_val_t a) { return countedNew(n, size_t(a)); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return countedAlloc(n, NEW_ALIGN); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return countedAlloc(n, NEW_ALIGN); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return countedAlloc(n, size_t(a)); }
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return countedAlloc(n, size_t(a)); }
+void operator delete(void* p) noexcept { countedFree(p, NEW_ALIGN); }
+void operator delete[](void* p) noexcept { countedFree(p, NEW_ALIGN); }
+void operator delete(void* p, size_t) noexcept { countedFree(p, NEW_ALIGN); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p, NEW_ALIGN); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countedFree(p, NEW_ALIGN); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { countedFree(p, NEW_ALIGN); }
+void operator delete(void* p, std::align_val_t a) noexcept { countedFree(p, size_t(a)); }
+void operator delete[](void* p, std::align_val_t a) noexcept { countedFree(p, size_t(a)); }
+void operator delete(void* p, size_t, std::align_val_t a) noexcept { countedFree(p, size_t(a)); }
+void operator delete[](void* p, size_t, std::align_val_t a) noexcept { countedFree(p, size_t(a)); }
+void operator delete(void* p, std::align_val_t a, const std::nothrow_t&) noexcept { countedFree(p, size_t(a)); }
+void operator delete[](void* p, std::align_val_t a, const std::nothrow_t&) noexcept { countedFree(p, size_t(a)); }
+#endif
+
+// Mono clip stored either as int16 or as float samples.
+struct Sound {
+    std::vector<int16_t> s16;
+    std::vector<float>   f32;
+    int frames() const { return int(s16.empty() ? f32.size() : s16.size()); }
+};
+enum Sfx { SFX_SHOOT, SFX_HIT, SFX_HURT, SFX_CLEAR, SFX_COUNT };
+
+struct Voice {
+    const Sound* snd = nullptr; // null = free
+    int pos = 0;
+    float gl = 0, gr = 0;
+};
+struct AudioCmd {
+    enum Op : uint8_t { Play, StopAll } op = Play;
+    uint16_t sound = 0;
+    float gain = 1.f, pan = 0.f;
+};
+struct Mixer {
+    std::vector<Sound> bank;            // immutable while the audio thread runs
+    std::array<Voice, MAX_VOICES> voices{};
+    SpscQueue<AudioCmd, 256> cmds;
+    alignas(16) float acc[AUDIO_BLOCK * 2];
+    std::atomic<uint32_t> dropped{ 0 }; // plays lost to a full queue or voice pool
+};
+static Mixer g_mixer;
+
+// Accumulate n frames of a mono voice into interleaved stereo.
+static void mixF32(float* acc, const float* src, int n, float gl, float gr) {
+    __m128 vl = _mm_set1_ps(gl), vr = _mm_set1_ps(gr);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 m = _mm_loadu_ps(src + i);
+        __m128 l = _mm_mul_ps(m, vl), r = _mm_mul_ps(m, vr);
+        float* o = acc + i * 2;
+        _mm_store_ps(o, _mm_add_ps(_mm_load_ps(o), _mm_unpacklo_ps(l, r)));
+        _mm_store_ps(o + 4, _mm_add_ps(_mm_load_ps(o + 4), _mm_unpackhi_ps(l, r)));
+    }
+    for (; i < n; ++i) { acc[i * 2] += src[i] * gl; acc[i * 2 + 1] += src[i] * gr; }
+}
+static void mixS16(float* acc, const int16_t* src, int n, float gl, float gr) {
+    const float k = 1.0f / 32768.0f;
+    __m128 vl = _mm_set1_ps(gl * k), vr = _mm_set1_ps(gr * k);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i w = _mm_loadl_epi64((const __m128i*)(src + i));
+        __m128 m = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16)); // sign-extend
+        __m128 l = _mm_mul_ps(m, vl), r = _mm_mul_ps(m, vr);
+        float* o = acc + i * 2;
+        _mm_store_ps(o, _mm_add_ps(_mm_load_ps(o), _mm_unpacklo_ps(l, r)));
+        _mm_store_ps(o + 4, _mm_add_ps(_mm_load_ps(o + 4), _mm_unpackhi_ps(l, r)));
+    }
+    for (; i < n; ++i) { acc[i * 2] += src[i] * gl * k; acc[i * 2 + 1] += src[i] * gr * k; }
+}
+
+static void mixerDrain(Mixer& M) {
+    AudioCmd c;
+    while (M.cmds.pop(c)) {
+        if (c.op == AudioCmd::StopAll) { for (auto& v : M.voices) v.snd = nullptr; continue; }
+        if (c.sound >= M.bank.size()) continue;
+        Voice* v = nullptr;
+        for (auto& cand : M.voices) if (!cand.snd) { v = &cand; break; }
+        if (!v) { M.dropped.fetch_add(1, std::memory_order_relaxed); continue; }
+        float a = (std::min(std::max(c.pan, -1.f), 1.f) + 1.f) * 0.25f * 3.14159265f; // constant power
+        v->snd = &M.bank[c.sound]; v->pos = 0;
+        v->gl = c.gain * std::cos(a); v->gr = c.gain * std::sin(a);
+    }
+}
+
+// Mix `frames` (<= AUDIO_BLOCK, multiple of 4) stereo frames into out.
+static void mixerRender(Mixer& M, int16_t* out, int frames) {
+    mixerDrain(M);
+    std::fill(M.acc, M.acc + frames * 2, 0.f);
+    for (auto& v : M.voices) {
+        if (!v.snd) continue;
+        int n = std::min(frames, v.snd->frames() - v.pos);
+        if (!v.snd->s16.empty()) mixS16(M.acc, v.snd->s16.data() + v.pos, n, v.gl, v.gr);
+        else mixF32(M.acc, v.snd->f32.data() + v.pos, n, v.gl, v.gr);
+        v.pos += n;
+        if (v.pos >= v.snd->frames()) v.snd = nullptr;
+    }
+    // clip and convert to int16
+    const __m128 lo = _mm_set1_ps(-1.f), hi = _mm_set1_ps(1.f), k = _mm_set1_ps(32767.f);
+    for (int i = 0; i < frames * 2; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_load_ps(M.acc + i), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_load_ps(M.acc + i + 4), lo), hi);
+        __m128i p = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, k)), _mm_cvtps_epi32(_mm_mul_ps(b, k)));
+        _mm_storeu_si128((__m128i*)(out + i), p);
+    }
+}
+
+// Procedural effects, so the demo stays a single file with no assets.
+static void buildSoundBank(Mixer& M) {
+    M.bank.assign(SFX_COUNT, Sound{});
+    auto synth = [](Sound& s, bool asFloat, float secs, auto&& fn) {
+        int n = int(secs * AUDIO_RATE);
+        for (int i = 0; i < n; ++i) {
+            float t = float(i) / AUDIO_RATE, v = fn(t, float(i) / n);
+            if (asFloat) s.f32.push_back(v);
+            else s.s16.push_back(int16_t(std::min(std::max(v, -1.f), 1.f) * 32767.f));
+        }
+    };
+    const float TAU = 6.2831853f;
+    uint32_t noise = 22222;
+    synth(M.bank[SFX_SHOOT], true, 0.08f, [&](float t, float u) {
+        float f = 900.f - 400.f * u;
+        return (std::sin(TAU * f * t) > 0 ? 0.5f : -0.5f) * (1.f - u);
+    });
+    synth(M.bank[SFX_HIT], false, 0.06f, [&](float, float u) {
+        noise = noise * 1664525u + 1013904223u;
+        return (float(noise >> 9) / float(1u << 23) * 2.f - 1.f) * 0.6f * (1.f - u);
+    });
+    synth(M.bank[SFX_HURT], false, 0.25f, [&](float t, float u) {
+        return std::sin(TAU * (220.f - 110.f * u) * t) * 0.8f * (1.f - u);
+    });
+    synth(M.bank[SFX_CLEAR], true, 0.4f, [&](float t, float u) {
+        return std::sin(TAU * (u < 0.5f ? 660.f : 880.f) * t) * 0.5f * (1.f - u);
+    });
+}
+
+static void sfxPlay(Sfx s, float gain = 1.f, float pan = 0.f) {
+    AudioCmd c; c.op = AudioCmd::Play; c.sound = uint16_t(s); c.gain = gain; c.pan = pan;
+    if (!g_mixer.cmds.push(c)) g_mixer.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+static float panAt(float x) { return (x - WIDTH * 0.5f) / (WIDTH * 0.5f); }
+
+enum class AudioSink { Device, Wav, Null };
+struct AudioOut {
+    AudioSink sink = AudioSink::Null;
+    std::thread th;
+    std::atomic<bool> run{ false };
+    std::vector<int16_t> buf;          // AUDIO_BUFFERS blocks, allocated before the thread starts
+    FILE* wav = nullptr;
+    uint32_t wavBytes = 0;
+#ifdef _WIN32
+    HWAVEOUT dev = nullptr;
+    HANDLE ev = nullptr;
+    WAVEHDR hdr[AUDIO_BUFFERS]{};
+#endif
+};
+static AudioOut g_audio;
+
+static void writeWavHeader(FILE* f, uint32_t dataBytes) {
+    auto u32 = [&](uint32_t v) { fwrite(&v, 4, 1, f); };
+    auto u16 = [&](uint16_t v) { fwrite(&v, 2, 1, f); };
+    fwrite("RIFF", 1, 4, f); u32(36 + dataBytes); fwrite("WAVEfmt ", 1, 8, f);
+    u32(16); u16(1); u16(2); u32(AUDIO_RATE); u32(AUDIO_RATE * 4); u16(4); u16(16);
+    fwrite("data", 1, 4, f); u32(dataBytes);
+}
+
+#ifdef _WIN32
+// waveOut signals the event whenever a block finishes; refill every finished block.
+static void audioDeviceThread(AudioOut& A) {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    for (auto& h : A.hdr) h.dwFlags |= WHDR_DONE;
+    while (A.run.load(std::memory_order_relaxed)) {
+        for (auto& h : A.hdr) {
+            if (!(h.dwFlags & WHDR_DONE)) continue;
+            mixerRender(g_mixer, (int16_t*)h.lpData, AUDIO_BLOCK);
+            waveOutWrite(A.dev, &h, sizeof(WAVEHDR));
+        }
+        WaitForSingleObject(A.ev, 50);
+    }
+}
+#endif
+// File and null sinks are paced to real time so they hear what the player would.
+static void audioFileThread(AudioOut& A) {
+    const auto period = std::chrono::microseconds(1000000LL * AUDIO_BLOCK / AUDIO_RATE);
+    auto next = std::chrono::steady_clock::now();
+    while (A.run.load(std::memory_order_relaxed)) {
+        mixerRender(g_mixer, A.buf.data(), AUDIO_BLOCK);
+        if (A.wav) { fwrite(A.buf.data(), 4, AUDIO_BLOCK, A.wav); A.wavBytes += AUDIO_BLOCK * 4; }
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+static void audioStart(AudioSink sink, const std::string& wavPath) {
+    AudioOut& A = g_audio;
+    buildSoundBank(g_mixer);
+    A.buf.assign(size_t(AUDIO_BLOCK) * 2 * AUDIO_BUFFERS, 0);
+    if (sink == AudioSink::Device) {
+#ifdef _WIN32
+        WAVEFORMATEX wf{};
+        wf.wFormatTag = WAVE_FORMAT_PCM; wf.nChannels = 2; wf.nSamplesPerSec = AUDIO_RATE;
+        wf.wBitsPerSample = 16; wf.nBlockAlign = 4; wf.nAvgBytesPerSec = AUDIO_RATE * 4;
+        A.ev = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        if (waveOutOpen(&A.dev, WAVE_MAPPER, &wf, (DWORD_PTR)A.ev, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+            CloseHandle(A.ev); A.ev = nullptr; A.dev = nullptr;
+            sink = AudioSink::Null; // no device: keep mixing so timing stays the same
+        }
+        else {
+            for (int i = 0; i < AUDIO_BUFFERS; ++i) {
+                A.hdr[i].lpData = (LPSTR)(A.buf.data() + size_t(i) * AUDIO_BLOCK * 2);
+                A.hdr[i].dwBufferLength = AUDIO_BLOCK * 4;
+                waveOutPrepareHeader(A.dev, &A.hdr[i], sizeof(WAVEHDR));
+            }
+        }
+#else
+        sink = AudioSink::Null; // no device sink outside Windows yet
+#endif
+    }
+    if (sink == AudioSink::Wav) {
+        A.wav = fopen(wavPath.c_str(), "wb");
+        if (A.wav) writeWavHeader(A.wav, 0);
+        else sink = AudioSink::Null;
+    }
+    A.sink = sink;
+    A.run = true;
+#ifdef _WIN32
+    if (sink == AudioSink::Device) { A.th = std::thread(audioDeviceThread, std::ref(A)); return; }
+#endif
+    A.th = std::thread(audioFileThread, std::ref(A));
+}
+
+static void audioStop() {
+    AudioOut& A = g_audio;
+    if (!A.run.exchange(false)) return;
+#ifdef _WIN32
+    if (A.ev) SetEvent(A.ev);
+#endif
+    A.th.join();
+#ifdef _WIN32
+    if (A.dev) {
+        waveOutReset(A.dev);
+        for (auto& h : A.hdr) waveOutUnprepareHeader(A.dev, &h, sizeof(WAVEHDR));
+        waveOutClose(A.dev); CloseHandle(A.ev);
+        A.dev = nullptr; A.ev = nullptr;
+    }
+#endif
+    if (A.wav) {
+        fseek(A.wav, 0, SEEK_SET);
+        writeWavHeader(A.wav, A.wavBytes);
+        fclose(A.wav); A.wav = nullptr;
+    }
+}
 
 enum class Dir { Up, Right, Down, Left };
 static std::array<Vec, 4> DIRV{ Vec(0,-1), Vec(1,0), Vec(0,1), Vec(-1,0) };
 
 struct Bullet {
     Vec p, v;
-    float r = 4.f, ttl = 1.1f;
+    Scalar r = 4.f, ttl = 1.1f;
     bool dead = false;
 };
 struct Enemy {
     Vec p;
-    float r = 12.f;
-    float hp = 2.f;       // Boss will get more
-    float speed = 55.f;
+    Scalar r = 12.f;
+    Scalar hp = 2.f;      // Boss will get more
+    Scalar speed = 55.f;
     int kind = 0;         // 0=chaser, 1=patroller
     Vec  patrolDir{ 1,0 };
+    Vec  prev;            // position at the start of the tick, for swept bullet tests
     bool dead = false;
 };
+
+// One bit per floor cell.
+struct Bits {
+    std::vector<uint64_t> w;
+    void reset(int n) { w.assign(size_t(n + 63) / 64, 0); }
+    bool test(int i) const { return w[size_t(i) >> 6] >> (i & 63) & 1; }
+    void set(int i) { w[size_t(i) >> 6] |= 1ull << (i & 63); }
+};
+
+// A floor, one cell per grid position in row order. Doors are a nibble per cell (bit d
+// opens toward Dir d, two cells to a byte), the room flags are bitsets, and all rooms
+// share one enemy pool: cell c owns pool[first[c], first[c] + count[c]). Ranges are laid
+// out in cell order when the floor is populated and only shrink afterwards, so the pool
+// never moves during play. A door always leads to an existing room.
+struct Floor {
+    int w = 0, h = 0;
+    std::vector<uint8_t> doors;
+    Bits exists, cleared, boss;
+    std::vector<uint32_t> first;
+    std::vector<uint8_t> count;
+    std::vector<Enemy> pool;
+
+    // Keeps the allocations, so a new floor of the same size costs no heap traffic.
+    void reset(int W, int H) {
+        w = W; h = H;
+        int n = W * H;
+        doors.assign(size_t(n + 1) / 2, 0);
+        exists.reset(n); cleared.reset(n); boss.reset(n);
+        first.assign(size_t(n), 0);
+        count.assign(size_t(n), 0);
+        pool.clear();
+    }
+    int cell(int x, int y) const { return y * w + x; }
+    int doorMask(int c) const { return doors[size_t(c) >> 1] >> ((c & 1) * 4) & 15; }
+    void addDoor(int c, Dir d) { doors[size_t(c) >> 1] |= uint8_t(1 << (int(d) + (c & 1) * 4)); }
+    // Cell through door d of cell c (which must have that door).
+    int through(int c, Dir d) const {
+        switch (d) {
+        case Dir::Up: return c - w;
+        case Dir::Right: return c + 1;
+        case Dir::Down: return c + w;
+        default: return c - 1;
+        }
+    }
+    bool anyUncleared() const {
+        for (size_t i = 0; i < exists.w.size(); ++i) if (exists.w[i] & ~cleared.w[i]) return true;
+        return false;
+    }
+    bool anyRoom() const {
+        for (uint64_t v : exists.w) if (v) return true;
+        return false;
+    }
+    // Rooms reachable from cell `from` through doors, breadth first; `seen` comes back
+    // with their bits set. `queue` is caller-owned scratch.
+    int reach(int from, Bits& seen, std::vector<int>& queue) const {
+        seen.reset(w * h);
+        queue.clear();
+        queue.push_back(from); seen.set(from);
+        for (size_t i = 0; i < queue.size(); ++i) {
+            int c = queue[i];
+            int m = doorMask(c);
+            for (int d = 0; d < 4; ++d) {
+                if (!(m >> d & 1)) continue;
+                int n = through(c, Dir(d));
+                if (seen.test(n)) continue;
+                seen.set(n); queue.push_back(n);
+            }
+        }
+        return int(queue.size());
+    }
+};
+
+// The enemies of one room: a window into the floor pool.
+struct EnemySpan {
+    Enemy* p; size_t n;
+    Enemy* begin() const { return p; }
+    Enemy* end() const { return p + n; }
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    Enemy& operator[](size_t i) const { return p[i]; }
+};
+
+// One cell of a floor, as the per-room code sees it. A handle, passed by value.
 struct Room {
-    bool exists = false;
-    bool cleared = false;
-    bool boss = false;
-    bool doors[4] = { false,false,false,false }; // U R D L
-    std::vector<Enemy> enemies;
+    Floor* F; int c;
+    bool exists() const { return F->exists.test(c); }
+    bool cleared() const { return F->cleared.test(c); }
+    bool boss() const { return F->boss.test(c); }
+    bool door(int d) const { return F->doorMask(c) >> d & 1; }
+    EnemySpan enemies() const { return { F->pool.data() + F->first[c], F->count[c] }; }
+    void markCleared() const { F->cleared.set(c); }
+    // Drops dead enemies, keeping the survivors in order.
+    void cullDead() const {
+        Enemy* e = F->pool.data() + F->first[c];
+        F->count[c] = uint8_t(std::remove_if(e, e + F->count[c], [](const Enemy& x) { return x.dead; }) - e);
+    }
 };
 
 struct Player {
     Vec p;
-    float r = 12.f;
-    float speed = 125.f;
+    Scalar r = 12.f;
+    Scalar speed = 125.f;
     int hp = 6; // 3 hearts
     std::vector<Bullet> shots;
-    float shotCooldown = 0.f;
+    Scalar shotCooldown = 0.f;
 } g_player;
 
 static const int GRID_W = 5, GRID_H = 5;
@@ -135,14 +1387,164 @@ static const int ROOM_W = 720, ROOM_H = 400;
 static const int ROOM_X = (WIDTH - ROOM_W) / 2;
 static const int ROOM_Y = (HEIGHT - ROOM_H) / 2;
 static const int DOOR_W = 80, DOOR_H = 18;
-static Room g_dungeon[GRID_H][GRID_W];
+static Floor g_floor;
 static int g_rx = GRID_W / 2, g_ry = GRID_H / 2; // current room
+static Room currentRoom() { return Room{ &g_floor, g_floor.cell(g_rx, g_ry) }; }
 static int g_startx, g_starty;
 static bool g_runOver = false;
 static bool g_allCleared = false;
 static RNG  g_rng;
+static uint32_t g_floorSerial = 0;    // bumped whenever a new floor is carved
+static uint32_t g_clearedVersion = 0; // bumped whenever any room's cleared flag changes
+
+// Feedback for the post-processing passes: kicked by hits, decays over game time. Not
+// part of the simulation state.
+struct ScreenFx {
+    float flash = 0, shake = 0, time = 0;
+} g_screenFx;
+static void screenFxTick(float dt) {
+    g_screenFx.flash = std::max(0.f, g_screenFx.flash - dt * 2.5f);
+    g_screenFx.shake = std::max(0.f, g_screenFx.shake - dt * 3.f);
+    g_screenFx.time += dt;
+}
+
+static bool g_headless = false;
+static bool g_botKeys[256];      // headless key state, written by botThink
+#ifndef _WIN32
+static bool g_keys[256];         // X11 key state by VK code, written by pumpMessages
+#endif
+static bool keyDown(int vk) {
+    if (g_headless) return g_botKeys[vk & 255];
+#ifdef _WIN32
+    return (GetAsyncKeyState(vk) & 0x8000) != 0;
+#else
+    return g_keys[vk & 255];
+#endif
+}
+
+// Key events for the simulation, stamped with nowSeconds() at the press or release:
+// from the window procedure, the X event loop or the headless bot. Each tick applies
+// the events up to its wall time (`until`; headless ticks take everything queued), so
+// input lands on the tick it belongs to instead of whichever frame happened to poll,
+// and a press released within one tick still holds its key for that tick (`latched`).
+// Menu keys (Escape, R, F12) are still polled through keyDown.
+struct InputEvent {
+    double t = 0;
+    uint8_t vk = 0;
+    bool down = false;
+};
+struct InputState {
+    SpscQueue<InputEvent, 256> queue;
+    bool sent[256] = {};       // producer: last state pushed per key
+    bool down[256] = {};       // consumer: state as of the current tick
+    bool latched[256] = {};    // consumer: pressed during the current tick
+    double until = 1e300;      // wall time of the tick being simulated
+    InputEvent next;           // popped but not due yet
+    bool hasNext = false;
+    uint64_t dropped = 0;
+    LatencyStats tickMs;       // press to the start of the tick that applies it
+};
+static InputState g_input;
+
+// Producer side. Repeats of an unchanged state are dropped here; sent only follows
+// edges that made it into the queue, so a dropped press or release is retried by the
+// next report of that key instead of being filtered out as a repeat.
+static void inputPush(int vk, bool down, double t) {
+    InputState& I = g_input;
+    vk &= 255;
+    if (I.sent[vk] == down) return;
+    InputEvent e; e.t = t; e.vk = uint8_t(vk); e.down = down;
+    if (I.queue.push(e)) I.sent[vk] = down;
+    else ++I.dropped;
+}
+// Focus loss: nothing held can be trusted to report its release.
+static void inputReleaseAll(double t) {
+    for (int vk = 0; vk < 256; ++vk) if (g_input.sent[vk]) inputPush(vk, false, t);
+}
+
+// Input-to-present latency. Every press a tick applies is followed through that tick,
+// the end of the first render after it and the end of the present that shows it
+// (headless: the end of the frame). F3 (-overlay headless) draws the recent samples
+// and the distribution over the frame; the stage statistics are printed at exit.
+struct PressTrace { double input, tick, render; }; // render 0 until rendered
+struct LatencyTrace {
+    static const int PENDING = 32, RECENT = 120;
+    PressTrace pend[PENDING];
+    int n = 0;
+    uint64_t dropped = 0, unseen = 0;
+    LatencyStats toTick, toRender, toPresent, total; // ms per stage, and end to end
+    float recent[RECENT][3] = {};                    // stage ms of the newest presses
+    uint64_t recentN = 0;
+    bool overlay = false;
+};
+static LatencyTrace g_trace;
+
+static void traceTick(double input, double tick) {
+    LatencyTrace& T = g_trace;
+    if (T.n == LatencyTrace::PENDING) { ++T.dropped; return; }
+    T.pend[T.n++] = { input, tick, 0.0 };
+}
+static void traceRendered() {
+    double t = nowSeconds();
+    for (int i = 0; i < g_trace.n; ++i) if (g_trace.pend[i].render == 0) g_trace.pend[i].render = t;
+}
+static void tracePresented() {
+    LatencyTrace& T = g_trace;
+    double t = nowSeconds();
+    int keep = 0;
+    for (int i = 0; i < T.n; ++i) {
+        const PressTrace& P = T.pend[i];
+        if (P.render == 0) { T.pend[keep++] = P; continue; }
+        double a = (P.tick - P.input) * 1e3, b = (P.render - P.tick) * 1e3, c = (t - P.render) * 1e3;
+        T.toTick.add(a); T.toRender.add(b); T.toPresent.add(c); T.total.add(a + b + c);
+        float* r = T.recent[T.recentN++ % LatencyTrace::RECENT];
+        r[0] = float(a); r[1] = float(b); r[2] = float(c);
+    }
+    T.n = keep;
+}
+// A frame skipped as unchanged: the presses it would have shown changed nothing.
+static void traceNothingShown() {
+    g_trace.unseen += uint64_t(g_trace.n);
+    g_trace.n = 0;
+}
+
+static void traceReport() {
+    const LatencyTrace& T = g_trace;
+    auto line = [](const char* name, const LatencyStats& L) {
+        printf("latency %-16s p50 %6.2f ms, p99 %6.2f ms, max %6.2f ms\n", name, L.pct(0.5), L.pct(0.99), L.max);
+    };
+    printf("latency: %llu presses traced to the screen, %llu with nothing to show, %llu dropped\n",
+        (unsigned long long)T.total.n, (unsigned long long)T.unseen, (unsigned long long)T.dropped);
+    line("input->tick", T.toTick);
+    line("tick->render", T.toRender);
+    line("render->present", T.toPresent);
+    line("input->present", T.total);
+}
+
+// Consumer side, at the start of every tick.
+static void inputTick() {
+    InputState& I = g_input;
+    memset(I.latched, 0, sizeof(I.latched));
+    double now = nowSeconds();
+    for (;;) {
+        if (!I.hasNext && !I.queue.pop(I.next)) break;
+        I.hasNext = true;
+        if (I.next.t > I.until) break;
+        I.hasNext = false;
+        I.down[I.next.vk] = I.next.down;
+        if (!I.next.down) continue;
+        I.latched[I.next.vk] = true;
+        I.tickMs.add((now - I.next.t) * 1e3);
+        traceTick(I.next.t, now);
+    }
+}
+static bool tickKey(int vk) { return g_input.down[vk & 255] || g_input.latched[vk & 255]; }
 
-static bool keyDown(int vk) { return (GetAsyncKeyState(vk) & 0x8000) != 0; }
+static void inputReport() {
+    const LatencyStats& L = g_input.tickMs;
+    printf("input: %llu presses, input-to-tick latency mean %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms, %llu dropped\n",
+        (unsigned long long)L.n, L.mean(), L.pct(0.5), L.pct(0.99), L.max, (unsigned long long)g_input.dropped);
+}
 
 static RECT doorRect(Dir d) {
     switch (d) {
@@ -153,43 +1555,49 @@ static RECT doorRect(Dir d) {
     }
     return RECT{ 0,0,0,0 };
 }
-static bool circleRectOverlap(const Vec& c, float r, const RECT& rc) {
-    float nx = clamp(c.x, float(rc.left), float(rc.right));
-    float ny = clamp(c.y, float(rc.top), float(rc.bottom));
-    float dx = c.x - nx, dy = c.y - ny;
+static bool circleRectOverlap(const Vec& c, Scalar r, const RECT& rc) {
+    Scalar nx = clamp(c.x, Scalar(int(rc.left)), Scalar(int(rc.right)));
+    Scalar ny = clamp(c.y, Scalar(int(rc.top)), Scalar(int(rc.bottom)));
+    Scalar dx = c.x - nx, dy = c.y - ny;
     return dx * dx + dy * dy <= r * r;
 }
 
-static void spawnEnemies(Room& R) {
-    R.enemies.clear();
-    int count = g_rng.randint(2, 5);
-    if (R.boss) { count = 6; }
+// Appends the room's enemies to the end of the pool, so rooms must be spawned in cell
+// order.
+static void spawnEnemies(Room R, RNG& rng) {
+    Floor& F = *R.F;
+    F.first[R.c] = uint32_t(F.pool.size());
+    int count = rng.randint(2, 5);
+    if (R.boss()) { count = 6; }
     for (int i = 0; i < count; ++i) {
         Enemy e;
-        e.p = Vec(g_rng.randf(ROOM_X + 40, ROOM_X + ROOM_W - 40),
-            g_rng.randf(ROOM_Y + 40, ROOM_Y + ROOM_H - 40));
-        e.kind = R.boss ? (i % 2) : g_rng.randint(0, 1);
-        if (R.boss) {
+        e.p = Vec(rng.randf(ROOM_X + 40, ROOM_X + ROOM_W - 40),
+            rng.randf(ROOM_Y + 40, ROOM_Y + ROOM_H - 40));
+        e.kind = R.boss() ? (i % 2) : rng.randint(0, 1);
+        if (R.boss()) {
             e.hp = 4.f;
             e.r = 14.f;
             e.speed = 70.f;
         }
-        R.enemies.push_back(e);
+        F.pool.push_back(e);
     }
-    R.cleared = R.enemies.empty();
+    F.count[R.c] = uint8_t(count);
+    if (count == 0) R.markCleared();
 }
 
-static void carveDungeon() {
+// Carves a new floor into F using rng alone, so floors can be made off the game thread.
+// The start room comes back in sx, sy.
+static void carveFloor(Floor& F, RNG& rng, int& sx, int& sy) {
     // Reset
-    for (int y = 0; y < GRID_H; ++y) for (int x = 0; x < GRID_W; ++x) g_dungeon[y][x] = Room{};
+    F.reset(GRID_W, GRID_H);
     // Random DFS from center to create ~6-9 rooms
-    int targetRooms = g_rng.randint(6, 9);
+    int targetRooms = rng.randint(6, 9);
     int cx = GRID_W / 2, cy = GRID_H / 2;
-    g_startx = cx; g_starty = cy;
+    sx = cx; sy = cy;
     struct Node { int x, y; };
     std::vector<Node> stack;
     std::vector<std::pair<int, int>> order;
-    g_dungeon[cy][cx].exists = true; order.push_back({ cx,cy });
+    F.exists.set(F.cell(cx, cy)); order.push_back({ cx,cy });
     stack.push_back({ cx,cy });
     int made = 1;
 
@@ -198,17 +1606,17 @@ static void carveDungeon() {
     while (made < targetRooms && !stack.empty()) {
         Node cur = stack.back();
         std::array<Dir, 4> dirs{ Dir::Up,Dir::Right,Dir::Down,Dir::Left };
-        std::shuffle(dirs.begin(), dirs.end(), g_rng.eng);
+        rng.shuffle(dirs.begin(), dirs.end());
         bool extended = false;
         for (Dir d : dirs) {
             int nx = cur.x + (d == Dir::Right ? 1 : (d == Dir::Left ? -1 : 0));
             int ny = cur.y + (d == Dir::Down ? 1 : (d == Dir::Up ? -1 : 0));
-            if (!inb(nx, ny) || g_dungeon[ny][nx].exists) continue;
+            if (!inb(nx, ny) || F.exists.test(F.cell(nx, ny))) continue;
             // carve
-            g_dungeon[cur.y][cur.x].exists = true;
-            g_dungeon[ny][nx].exists = true;
-            g_dungeon[cur.y][cur.x].doors[(int)d] = true;
-            g_dungeon[ny][nx].doors[(int)((int(d) + 2) % 4)] = true;
+            F.exists.set(F.cell(cur.x, cur.y));
+            F.exists.set(F.cell(nx, ny));
+            F.addDoor(F.cell(cur.x, cur.y), d);
+            F.addDoor(F.cell(nx, ny), Dir((int(d) + 2) % 4));
             stack.push_back({ nx,ny });
             order.push_back({ nx,ny });
             ++made; extended = true;
@@ -218,96 +1626,698 @@ static void carveDungeon() {
     }
 
     // Boss room = farthest from start among existing
-    auto dist = [&](int x, int y) { int dx = x - g_startx, dy = y - g_starty; return dx * dx + dy * dy; };
-    int bx = g_startx, by = g_starty, best = -1;
+    auto dist = [&](int x, int y) { int dx = x - sx, dy = y - sy; return dx * dx + dy * dy; };
+    int bx = sx, by = sy, best = -1;
     for (int y = 0; y < GRID_H; ++y)for (int x = 0; x < GRID_W; ++x) {
-        if (!g_dungeon[y][x].exists) continue;
+        if (!F.exists.test(F.cell(x, y))) continue;
         int d = dist(x, y);
         if (d > best) { best = d; bx = x; by = y; }
     }
-    g_dungeon[by][bx].boss = true;
+    F.boss.set(F.cell(bx, by));
 
-    // Populate enemies
-    for (int y = 0; y < GRID_H; ++y)for (int x = 0; x < GRID_W; ++x) {
-        if (g_dungeon[y][x].exists) {
-            if (x == g_startx && y == g_starty) { g_dungeon[y][x].cleared = true; } // spawn room safe
-            else spawnEnemies(g_dungeon[y][x]);
-        }
+    // Populate enemies, in cell order so each room's range follows the previous one
+    for (int c = 0; c < GRID_W * GRID_H; ++c) {
+        F.first[c] = uint32_t(F.pool.size());
+        if (!F.exists.test(c)) continue;
+        if (c == F.cell(sx, sy)) F.cleared.set(c); // spawn room safe
+        else spawnEnemies(Room{ &F, c }, rng);
     }
 }
 
-static void resetRun() {
-    carveDungeon();
-    g_rx = g_startx; g_ry = g_starty;
-    g_player = Player{};
-    g_player.p = Vec(ROOM_X + ROOM_W / 2.f, ROOM_Y + ROOM_H / 2.f);
-    g_runOver = false;
-    g_allCleared = false;
+static void carveDungeon() {
+    carveFloor(g_floor, g_rng, g_startx, g_starty);
+    ++g_floorSerial;
 }
 
-static void drawHUD() {
-    // hearts
-    int x = ROOM_X, y = ROOM_Y - 28;
-    for (int i = 0; i < g_player.hp; ++i) {
-        fillRect(x + i * 16, y, 14, 14, RGBA(220, 40, 40));
+// ---------------------------------------------------------------------------
+// Endless descent (-endless <log>): clearing a floor moves the player down to the next
+// one instead of ending the run. Floor d is carved from its own seed, so a worker can
+// build the next AHEAD floors while the current one is played. Descending swaps the
+// next floor in (vector swaps, no copies or allocations) and hands the floor left
+// behind to the worker, which appends its summary to the log and reuses its storage
+// for the floor AHEAD levels further down. At most AHEAD + 1 floors are resident
+// however deep the run goes.
+// ---------------------------------------------------------------------------
+
+// Log record of a floor left behind: its map, plus the seed to regenerate the rest.
+struct FloorSummary {
+    uint64_t seed;
+    uint32_t depth;
+    uint16_t rooms;
+    uint8_t start, boss;                      // cells
+    uint8_t doors[(GRID_W * GRID_H + 1) / 2]; // Floor::doors
+    uint8_t pad[3];
+};
+static_assert(sizeof(FloorSummary) == 32, "FloorSummary is a fixed 32-byte record");
+static_assert(GRID_W * GRID_H <= 256, "FloorSummary cells are bytes");
+
+struct Descent {
+    static const int AHEAD = 2;         // floors generated ahead of the current one
+    struct Slot {
+        Floor F;
+        int depth = 0, sx = 0, sy = 0;  // the floor held, or to carve when !ready
+        int leftDepth = -1;             // floor to summarize before carving, -1 for none
+        bool ready = false;
+    };
+    bool on = false;
+    FILE* log = nullptr;
+    uint64_t seed = 0;
+    int depth = 0;                      // current floor
+    Slot slots[AHEAD];                  // floor d lives in slots[d % AHEAD]
+    std::thread th;
+    std::mutex m;
+    std::condition_variable cv;         // slot became ready / slot needs work
+    bool quit = false;
+    std::atomic<uint64_t> logged{ 0 };
+    LatencyStats latUs;                 // descend() wall time, including any wait for the worker
+    uint64_t waits = 0;
+};
+static Descent g_descent;
+
+static uint64_t floorSeed(uint64_t runSeed, int depth) { // splitmix64 step
+    uint64_t z = runSeed + 0x9e3779b97f4a7c15ull * uint64_t(depth + 1);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static void descentSummarize(Descent& D, const Descent::Slot& s) {
+    const Floor& F = s.F;
+    FloorSummary r = {};
+    r.seed = floorSeed(D.seed, s.leftDepth);
+    r.depth = uint32_t(s.leftDepth);
+    r.start = uint8_t(F.cell(s.sx, s.sy));
+    for (int c = 0; c < F.w * F.h; ++c) {
+        r.rooms += F.exists.test(c);
+        if (F.boss.test(c)) r.boss = uint8_t(c);
     }
-    // room marker & tips
-    std::string txt = "WASD move | Arrows shoot | R restart | ESC quit";
-    // primitive text: draw tiny bars for legibility
-    // (Keep simple: just draw a thin top bar as a "HUD line")
-    drawRect(ROOM_X, ROOM_Y - 34, ROOM_W, 1, RGBA(255, 255, 255));
-    // mini-map dots
-    int mx = ROOM_X + ROOM_W - 120, my = ROOM_Y - 26;
-    for (int y = 0; y < GRID_H; ++y) {
-        for (int x = 0; x < GRID_W; ++x) {
-            if (!g_dungeon[y][x].exists) continue;
-            uint32_t c = RGBA(120, 120, 120);
-            if (g_dungeon[y][x].boss) c = RGBA(200, 90, 200);
-            if (x == g_rx && y == g_ry) c = RGBA(255, 255, 255);
-            fillRect(mx + x * 8, my + y * 8, 6, 6, c);
+    memcpy(r.doors, F.doors.data(), sizeof(r.doors));
+    if (D.log && fwrite(&r, sizeof(r), 1, D.log) == 1) D.logged.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Worker: summarizes and recarves freed slots, nearest depth first. Finishes pending
+// work before honouring quit, so every floor left behind reaches the log.
+static void descentThread(Descent& D) {
+    std::unique_lock<std::mutex> lk(D.m);
+    for (;;) {
+        Descent::Slot* s = nullptr;
+        for (Descent::Slot& x : D.slots) if (!x.ready && (!s || x.depth < s->depth)) s = &x;
+        if (!s) {
+            if (D.quit) return;
+            D.cv.wait(lk);
+            continue;
         }
-    }
-    // win/lose banner
-    if (g_runOver) {
-        // in future render on screen text properly; for now just a box with fake text bars
-        std::string s = (g_player.hp <= 0) ? "You Died - Press R to Retry" : "Floor Cleared! Press R for New Run";
-        int bw = 450, bh = 50;
-        fillRect((WIDTH - bw) / 2, (HEIGHT - bh) / 2, bw, bh, RGBA(0, 0, 0, 220));
-        drawRect((WIDTH - bw) / 2, (HEIGHT - bh) / 2, bw, bh, RGBA(255, 255, 255));
-        // fake "text": centered bars
-        // title bar
-        fillRect((WIDTH - bw) / 2 + 14, (HEIGHT - bh) / 2 + 14, bw - 28, 4, RGBA(255, 255, 255));
-        // subtitle-ish
-        fillRect((WIDTH - bw) / 2 + 80, (HEIGHT - bh) / 2 + 30, bw - 160, 3, RGBA(200, 200, 200));
+        lk.unlock();
+        if (s->leftDepth >= 0) descentSummarize(D, *s);
+        RNG rng(floorSeed(D.seed, s->depth));
+        carveFloor(s->F, rng, s->sx, s->sy);
+        lk.lock();
+        s->leftDepth = -1;
+        s->ready = true;
+        D.cv.notify_all();
     }
 }
 
-static void drawRoom(const Room& R) {
-    // walls
-    fillRect(ROOM_X, ROOM_Y, ROOM_W, ROOM_H, RGBA(20, 20, 25));
-    drawRect(ROOM_X, ROOM_Y, ROOM_W, ROOM_H, RGBA(200, 200, 200));
-    // doors (closed if uncleared)
-    for (int i = 0; i < 4; ++i) {
-        if (!R.doors[i]) continue;
-        RECT rc = doorRect((Dir)i);
-        bool locked = !R.cleared;
-        uint32_t col = locked ? RGBA(180, 60, 60) : RGBA(100, 220, 120);
-        fillRect(rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top, col);
-    }
-    // boss tint
-    if (R.boss) {
-        // subtle border glow
-        drawRect(ROOM_X + 3, ROOM_Y + 3, ROOM_W - 6, ROOM_H - 6, RGBA(200, 80, 200));
+static void descentStopWorker(Descent& D) {
+    if (!D.th.joinable()) return;
+    { std::lock_guard<std::mutex> lk(D.m); D.quit = true; }
+    D.cv.notify_all();
+    D.th.join();
+}
+
+// Starts a descent at depth 0: the first floor is carved here, the next AHEAD by the
+// worker. Called by resetRun while endless mode is on.
+static void descentBegin(uint64_t seed) {
+    Descent& D = g_descent;
+    descentStopWorker(D);
+    D.seed = seed;
+    D.depth = 0;
+    RNG rng(floorSeed(seed, 0));
+    carveFloor(g_floor, rng, g_startx, g_starty);
+    ++g_floorSerial;
+    for (int d = 1; d <= Descent::AHEAD; ++d) {
+        Descent::Slot& s = D.slots[d % Descent::AHEAD];
+        s.depth = d; s.leftDepth = -1; s.ready = false;
     }
+    D.quit = false;
+    D.th = std::thread(descentThread, std::ref(D));
 }
 
-static void updateEnemies(Room& R, float dt) {
-    for (auto& e : R.enemies) {
-        if (e.dead) continue;
+// Moves the player to the start room of the next floor.
+static void descend() {
+    Descent& D = g_descent;
+    double t0 = nowSeconds();
+    {
+        std::unique_lock<std::mutex> lk(D.m);
+        Descent::Slot& s = D.slots[(D.depth + 1) % Descent::AHEAD];
+        if (!s.ready) {
+            ++D.waits;
+            D.cv.wait(lk, [&] { return s.ready; });
+        }
+        std::swap(g_floor, s.F);
+        std::swap(g_startx, s.sx); std::swap(g_starty, s.sy);
+        s.leftDepth = D.depth;
+        s.depth = D.depth + 1 + Descent::AHEAD;
+        s.ready = false;
+        ++D.depth;
+    }
+    D.cv.notify_all();
+    metricAdd(M_FLOORS);
+    ++g_floorSerial; ++g_clearedVersion;
+    g_rx = g_startx; g_ry = g_starty;
+    g_player.p = Vec(ROOM_X + ROOM_W / 2.f, ROOM_Y + ROOM_H / 2.f);
+    g_player.shots.clear();
+    g_allCleared = false;
+    D.latUs.add((nowSeconds() - t0) * 1e6);
+}
+
+static void descentStart(FILE* log) {
+    Descent& D = g_descent;
+    D.on = true;
+    D.log = log;
+    D.logged = 0; D.latUs = LatencyStats{}; D.waits = 0;
+}
+
+static bool descentNextReady() {
+    Descent& D = g_descent;
+    std::lock_guard<std::mutex> lk(D.m);
+    return D.slots[(D.depth + 1) % Descent::AHEAD].ready;
+}
+
+// -endless: opens the summary log and turns the mode on, before the first resetRun.
+static bool descentOpen(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) { fprintf(stderr, "endless: cannot open %s\n", path.c_str()); return false; }
+    descentStart(f);
+    return true;
+}
+
+// Heap bytes held by the resident floors.
+static size_t descentResidentBytes() {
+    auto bytes = [](const Floor& F) {
+        return F.doors.capacity() + (F.exists.w.capacity() + F.cleared.w.capacity() + F.boss.w.capacity()) * 8 +
+            F.first.capacity() * sizeof(uint32_t) + F.count.capacity() + F.pool.capacity() * sizeof(Enemy);
+    };
+    size_t n = bytes(g_floor);
+    for (const Descent::Slot& s : g_descent.slots) n += bytes(s.F);
+    return n;
+}
+
+static void descentReport() {
+    Descent& D = g_descent;
+    printf("descent: %llu floors, depth %d, latency mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us, %llu waits for the worker\n",
+        (unsigned long long)D.latUs.n, D.depth, D.latUs.mean(), D.latUs.pct(0.5), D.latUs.pct(0.99), D.latUs.max,
+        (unsigned long long)D.waits);
+    printf("descent: %llu floors summarized (%llu bytes), %zu bytes resident\n", (unsigned long long)D.logged.load(),
+        (unsigned long long)(D.logged.load() * sizeof(FloorSummary)), descentResidentBytes());
+}
+
+// Drains the worker (every floor left behind is logged) and closes the log.
+static void descentStop() {
+    Descent& D = g_descent;
+    if (!D.on) return;
+    descentStopWorker(D);
+    if (D.log) fclose(D.log);
+    D.log = nullptr;
+    D.on = false;
+}
+
+static void resetRun() {
+    metricAdd(M_RUNS);
+    if (g_descent.on) descentBegin(g_rng.eng());
+    else carveDungeon();
+    g_rx = g_startx; g_ry = g_starty;
+    g_player = Player{};
+    g_player.p = Vec(ROOM_X + ROOM_W / 2.f, ROOM_Y + ROOM_H / 2.f);
+    g_runOver = false;
+    g_allCleared = false;
+}
+
+// Pre-rendered HUD pieces. They only change on room moves, clears and damage, so they are
+// rebuilt when their key changes and blitted every frame. LAYER_CLEAR pixels are transparent.
+static const uint32_t LAYER_CLEAR = 0;
+static const int MINIMAP_CELLS = 5; // visible window (in rooms) on each axis
+static const int MINIMAP_PITCH = 8;
+struct HudLayer {
+    int x = 0, y = 0;
+    Surface surf;
+    std::vector<uint32_t> store;
+    uint64_t key = ~0ull;
+};
+static HudLayer g_heartsLayer, g_minimapLayer;
+
+static void layerBegin(HudLayer& L, int x, int y, int w, int h) {
+    L.x = x; L.y = y;
+    L.store.assign(size_t(w) * h, LAYER_CLEAR);
+    L.surf.px = L.store.data(); L.surf.w = w; L.surf.h = h;
+    g_target = &L.surf;
+}
+static void layerEnd() { g_target = &g_fb; }
+
+// Copies the opaque runs of a layer onto the current target.
+static void blitLayer(const HudLayer& L) {
+    const Surface& s = L.surf;
+    for (int j = 0; j < s.h; ++j) {
+        int ty = L.y + j;
+        if (ty < g_target->top || ty >= g_target->h) continue;
+        const uint32_t* src = s.px + j * s.w;
+        uint32_t* dst = g_target->px + ty * g_target->w;
+        int i = 0;
+        while (i < s.w) {
+            while (i < s.w && src[i] == LAYER_CLEAR) ++i;
+            int run = i;
+            while (i < s.w && src[i] != LAYER_CLEAR) ++i;
+            int x0 = std::max(L.x + run, 0), x1 = std::min(L.x + i, g_target->w);
+            if (x1 > x0) std::copy(src + (x0 - L.x), src + (x1 - L.x), dst + x0);
+        }
+    }
+}
+
+static void rebuildHearts() {
+    int n = std::max(g_player.hp, 0);
+    layerBegin(g_heartsLayer, ROOM_X, ROOM_Y - 28, std::max(n * 16, 1), 14);
+    for (int i = 0; i < n; ++i) fillRect(i * 16, 0, 14, 14, RGBA(220, 40, 40));
+    layerEnd();
+}
+
+// Draws a MINIMAP_CELLS-wide window of the grid around the current room, so big floors
+// cost the same as small ones.
+static void rebuildMinimap() {
+    int wx = clamp(g_rx - MINIMAP_CELLS / 2, 0, std::max(GRID_W - MINIMAP_CELLS, 0));
+    int wy = clamp(g_ry - MINIMAP_CELLS / 2, 0, std::max(GRID_H - MINIMAP_CELLS, 0));
+    int cw = std::min(GRID_W, MINIMAP_CELLS), ch = std::min(GRID_H, MINIMAP_CELLS);
+    layerBegin(g_minimapLayer, ROOM_X + ROOM_W - 120, ROOM_Y - 26, cw * MINIMAP_PITCH, ch * MINIMAP_PITCH);
+    for (int y = 0; y < ch; ++y) {
+        for (int x = 0; x < cw; ++x) {
+            Room R{ &g_floor, g_floor.cell(wx + x, wy + y) };
+            if (!R.exists()) continue;
+            uint32_t c = RGBA(120, 120, 120);
+            if (R.boss()) c = RGBA(200, 90, 200);
+            if (wx + x == g_rx && wy + y == g_ry) c = RGBA(255, 255, 255);
+            fillRect(x * MINIMAP_PITCH, y * MINIMAP_PITCH, 6, 6, c);
+        }
+    }
+    layerEnd();
+}
+
+static void drawHUD() {
+    // hearts
+    uint64_t heartsKey = uint64_t(uint32_t(g_player.hp));
+    if (heartsKey != g_heartsLayer.key) { rebuildHearts(); g_heartsLayer.key = heartsKey; }
+    blitLayer(g_heartsLayer);
+    // room marker & tips
+    std::string txt = "WASD move | Arrows shoot | R restart | ESC quit";
+    // primitive text: draw tiny bars for legibility
+    // (Keep simple: just draw a thin top bar as a "HUD line")
+    hspan(ROOM_X, ROOM_X + ROOM_W, ROOM_Y - 34, RGBA(255, 255, 255));
+    // mini-map dots
+    uint64_t mapKey = (uint64_t(g_floorSerial) << 24) ^ (uint64_t(g_ry) << 12) ^ uint64_t(g_rx);
+    if (mapKey != g_minimapLayer.key) { rebuildMinimap(); g_minimapLayer.key = mapKey; }
+    blitLayer(g_minimapLayer);
+    // win/lose banner
+    if (g_runOver) {
+        // in future render on screen text properly; for now just a box with fake text bars
+        std::string s = (g_player.hp <= 0) ? "You Died - Press R to Retry" : "Floor Cleared! Press R for New Run";
+        int bw = 450, bh = 50;
+        fillRect((WIDTH - bw) / 2, (HEIGHT - bh) / 2, bw, bh, RGBA(0, 0, 0, 220));
+        drawRect((WIDTH - bw) / 2, (HEIGHT - bh) / 2, bw, bh, RGBA(255, 255, 255));
+        // fake "text": centered bars
+        // title bar
+        fillRect((WIDTH - bw) / 2 + 14, (HEIGHT - bh) / 2 + 14, bw - 28, 4, RGBA(255, 255, 255));
+        // subtitle-ish
+        fillRect((WIDTH - bw) / 2 + 80, (HEIGHT - bh) / 2 + 30, bw - 160, 3, RGBA(200, 200, 200));
+    }
+}
+
+// F3: the newest presses as stacked bars (input->tick, tick->render, render->present)
+// against 1- and 2-frame lines, and a 1 ms histogram of the last LatencyStats::WINDOW
+// end-to-end samples with p50 (white) and p99 (red) marks.
+static void drawLatencyOverlay() {
+    const LatencyTrace& T = g_trace;
+    const int PX_PER_MS = 4, MAX_MS = 40, BAR = 3, BINS = 40, BIN_W = 6;
+    const int H = MAX_MS * PX_PER_MS, x0 = 10, y0 = HEIGHT - 10 - H;
+    const int bw = LatencyTrace::RECENT * BAR, hx = x0 + bw + 10;
+    fillRect(x0 - 4, y0 - 4, bw + 10 + BINS * BIN_W + 8, H + 8, RGBA(0, 0, 0));
+    for (float ms : { 1000.f / 60, 2000.f / 60 }) hspan(x0, x0 + bw, y0 + H - int(ms * PX_PER_MS), RGBA(90, 90, 90));
+    static const uint32_t STAGE[3] = { RGBA(240, 200, 60), RGBA(80, 200, 240), RGBA(220, 90, 220) };
+    uint64_t n = std::min<uint64_t>(T.recentN, LatencyTrace::RECENT);
+    for (uint64_t i = 0; i < n; ++i) {
+        const float* r = T.recent[(T.recentN - n + i) % LatencyTrace::RECENT];
+        int y = y0 + H;
+        for (int s = 0; s < 3 && y > y0; ++s) {
+            int h = std::min(int(r[s] * PX_PER_MS + 0.5f), y - y0);
+            fillRect(x0 + int(i) * BAR, y - h, BAR - 1, h, STAGE[s]);
+            y -= h;
+        }
+    }
+    int bins[BINS] = {}, peak = 1;
+    uint64_t m = std::min<uint64_t>(T.total.n, LatencyStats::WINDOW);
+    for (uint64_t i = 0; i < m; ++i) peak = std::max(peak, ++bins[std::min(int(T.total.last[i]), BINS - 1)]);
+    for (int b = 0; b < BINS; ++b) {
+        int h = bins[b] * H / peak;
+        fillRect(hx + b * BIN_W, y0 + H - h, BIN_W - 1, h, RGBA(160, 160, 160));
+    }
+    if (m) {
+        vspan(hx + std::min(int(T.total.pct(0.5) * BIN_W), BINS * BIN_W - 1), y0, y0 + H, RGBA(255, 255, 255));
+        vspan(hx + std::min(int(T.total.pct(0.99) * BIN_W), BINS * BIN_W - 1), y0, y0 + H, RGBA(255, 60, 60));
+    }
+}
+
+// Little-endian field access for the binary formats below.
+static void putU16(std::vector<uint8_t>& o, uint16_t v) { o.push_back(uint8_t(v)); o.push_back(uint8_t(v >> 8)); }
+static void putU32(std::vector<uint8_t>& o, uint32_t v) { for (int k = 0; k < 4; ++k) o.push_back(uint8_t(v >> (k * 8))); }
+static uint16_t getU16(const uint8_t* p) { return uint16_t(p[0] | (p[1] << 8)); }
+static uint32_t getU32(const uint8_t* p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+
+// ---------------------------------------------------------------------------
+// Sprites: a packed atlas of run-length-encoded sprites. Only opaque pixels are stored,
+// as runs after a transparent skip, so the blitter never visits empty pixels; rows
+// outside the target are skipped through the row table and runs are clipped whole.
+// The atlas is memory-mapped from disk with -atlas <file> (baked and written there on
+// first use), otherwise baked in memory at startup.
+//
+// Atlas (little-endian, every field 4-byte aligned): "ISP2", u16 count, u16 PixelFormat of
+// the pixels (files for another framebuffer format are rebaked), then count x
+// (u16 w, u16 h, u32 rowTable); rowTable is h x u32 row offsets; a row is u32 runCount
+// followed by runCount x (u16 skip, u16 len, len x u32 pixels). Offsets are from the
+// start of the atlas.
+// ---------------------------------------------------------------------------
+enum Spr { SPR_BULLET, SPR_RING, SPR_COUNT };
+
+struct FileMapping {
+    const uint8_t* base = nullptr;
+    size_t bytes = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+static bool mapFile(FileMapping& M, const std::string& path) {
+#ifdef _WIN32
+    M.file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (M.file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(M.file, &size) || size.QuadPart == 0 ||
+        !(M.mapping = CreateFileMapping(M.file, nullptr, PAGE_READONLY, 0, 0, nullptr))) {
+        CloseHandle(M.file); M.file = INVALID_HANDLE_VALUE; return false;
+    }
+    M.base = (const uint8_t*)MapViewOfFile(M.mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!M.base) { CloseHandle(M.mapping); CloseHandle(M.file); M.mapping = nullptr; M.file = INVALID_HANDLE_VALUE; return false; }
+    M.bytes = size_t(size.QuadPart);
+#else
+    M.fd = open(path.c_str(), O_RDONLY);
+    if (M.fd < 0) return false;
+    struct stat st{};
+    void* p = fstat(M.fd, &st) == 0 && st.st_size > 0 ? mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, M.fd, 0) : MAP_FAILED;
+    if (p == MAP_FAILED) { close(M.fd); M.fd = -1; return false; }
+    M.base = (const uint8_t*)p; M.bytes = size_t(st.st_size);
+#endif
+    return true;
+}
+static void unmapFile(FileMapping& M) {
+    if (!M.base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(M.base);
+    CloseHandle(M.mapping);
+    CloseHandle(M.file);
+#else
+    munmap((void*)M.base, M.bytes);
+    close(M.fd);
+#endif
+    M.base = nullptr;
+}
+
+struct SpriteAtlas {
+    const uint8_t* base = nullptr;
+    size_t bytes = 0;
+    std::vector<uint8_t> baked; // backing store when not mapped
+    FileMapping file;
+};
+static SpriteAtlas g_atlas;
+
+static int spriteW(const SpriteAtlas& A, int id) { return getU16(A.base + 8 + id * 8); }
+static int spriteH(const SpriteAtlas& A, int id) { return getU16(A.base + 10 + id * 8); }
+
+// Encodes sprite id from fn's drawing on a w x h LAYER_CLEAR surface, appending its rows.
+static void bakeSprite(std::vector<uint8_t>& atlas, int id, int w, int h, const std::function<void()>& fn) {
+    std::vector<uint32_t> px(size_t(w) * h, LAYER_CLEAR);
+    Surface s; s.px = px.data(); s.w = w; s.h = h;
+    g_target = &s;
+    fn();
+    g_target = &g_fb;
+    uint32_t table = uint32_t(atlas.size());
+    uint8_t* hdr = atlas.data() + 8 + id * 8;
+    hdr[0] = uint8_t(w); hdr[1] = uint8_t(w >> 8); hdr[2] = uint8_t(h); hdr[3] = uint8_t(h >> 8);
+    memcpy(hdr + 4, &table, 4);
+    atlas.resize(atlas.size() + size_t(h) * 4);
+    for (int j = 0; j < h; ++j) {
+        uint32_t rowOff = uint32_t(atlas.size());
+        memcpy(atlas.data() + table + j * 4, &rowOff, 4);
+        std::vector<uint8_t> row(4);
+        uint32_t runs = 0;
+        const uint32_t* src = px.data() + size_t(j) * w;
+        for (int i = 0, end = 0; i < w; ) {
+            while (i < w && src[i] == LAYER_CLEAR) ++i;
+            if (i == w) break;
+            int start = i;
+            while (i < w && src[i] != LAYER_CLEAR) ++i;
+            putU16(row, uint16_t(start - end)); putU16(row, uint16_t(i - start));
+            for (int k = start; k < i; ++k) putU32(row, src[k]);
+            end = i;
+            ++runs;
+        }
+        memcpy(row.data(), &runs, 4);
+        atlas.insert(atlas.end(), row.begin(), row.end());
+    }
+}
+
+static std::vector<uint8_t> bakeAtlas() {
+    std::vector<uint8_t> a(8 + SPR_COUNT * 8, 0);
+    memcpy(a.data(), "ISP2", 4);
+    uint16_t count = SPR_COUNT, format = uint16_t(FB_FORMAT);
+    memcpy(a.data() + 4, &count, 2);
+    memcpy(a.data() + 6, &format, 2);
+    bakeSprite(a, SPR_BULLET, 11, 11, [] { fillCircle(5, 5, 5, RGBA(255, 255, 255)); });
+    bakeSprite(a, SPR_RING, 32, 32, [] { // hollow shape with two runs per middle row
+        fillCircle(16, 16, 15, RGBA(250, 200, 90));
+        fillCircle(16, 16, 9, LAYER_CLEAR);
+    });
+    return a;
+}
+
+// Walks every run once so a truncated or foreign file is rejected up front.
+static bool atlasValid(const uint8_t* p, size_t n) {
+    if (n < 8 || memcmp(p, "ISP2", 4) != 0 || getU16(p + 4) < SPR_COUNT || getU16(p + 6) != uint16_t(FB_FORMAT) ||
+        8 + size_t(SPR_COUNT) * 8 > n) return false;
+    for (int id = 0; id < SPR_COUNT; ++id) {
+        const uint8_t* hdr = p + 8 + id * 8;
+        size_t w = getU16(hdr), h = getU16(hdr + 2), table = getU32(hdr + 4);
+        if (table + h * 4 > n) return false;
+        for (size_t j = 0; j < h; ++j) {
+            size_t o = getU32(p + table + j * 4);
+            if (o + 4 > n) return false;
+            uint32_t runs = getU32(p + o);
+            size_t x = 0;
+            o += 4;
+            for (uint32_t r = 0; r < runs; ++r) {
+                if (o + 4 > n) return false;
+                size_t len = getU16(p + o + 2);
+                x += getU16(p + o) + len;
+                o += 4 + len * 4;
+                if (x > w || o > n) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Maps path if it holds a valid atlas; otherwise bakes one (and writes it to path, if
+// given, for the next start).
+static void atlasLoad(SpriteAtlas& A, const std::string& path) {
+    if (!path.empty() && mapFile(A.file, path)) {
+        if (atlasValid(A.file.base, A.file.bytes)) { A.base = A.file.base; A.bytes = A.file.bytes; return; }
+        fprintf(stderr, "atlas: %s is not a sprite atlas for this build, baking a new one\n", path.c_str());
+        unmapFile(A.file);
+    }
+    A.baked = bakeAtlas();
+    A.base = A.baked.data(); A.bytes = A.baked.size();
+    if (path.empty()) return;
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f) { fwrite(A.baked.data(), 1, A.baked.size(), f); fclose(f); }
+}
+static void atlasFree(SpriteAtlas& A) {
+    unmapFile(A.file);
+    A.baked.clear();
+    A.base = nullptr;
+}
+
+static inline void copySpan(uint32_t* dst, const uint32_t* src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i)), b = _mm_loadu_si128((const __m128i*)(src + i + 4));
+        _mm_storeu_si128((__m128i*)(dst + i), a);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), b);
+    }
+    if (i + 4 <= n) { _mm_storeu_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i))); i += 4; }
+    for (; i < n; ++i) dst[i] = src[i];
+}
+
+// Draws sprite id with its top-left corner at (x, y) on the current target.
+static void blitSprite(const SpriteAtlas& A, int id, int x, int y) {
+    int w = spriteW(A, id), h = spriteH(A, id);
+    int tw = g_target->w, th = g_target->h;
+    if (x >= tw || y >= th || x + w <= 0 || y + h <= g_target->top) return;
+    const uint8_t* table = A.base + getU32(A.base + 12 + id * 8);
+    bool clipX = x < 0 || x + w > tw;
+    for (int j = std::max(0, g_target->top - y), j1 = std::min(h, th - y); j < j1; ++j) {
+        const uint8_t* p = A.base + getU32(table + j * 4);
+        uint32_t runs = getU32(p);
+        p += 4;
+        size_t row = size_t(y + j) * tw;
+        int cx = x;
+        for (uint32_t r = 0; r < runs; ++r) {
+            cx += getU16(p);
+            int len = getU16(p + 2);
+            const uint32_t* src = (const uint32_t*)(p + 4);
+            p += 4 + len * 4;
+            int x0 = clipX ? std::max(cx, 0) : cx, x1 = clipX ? std::min(cx + len, tw) : cx + len;
+            if (g_target->idx) for (int i = x0; i < x1; ++i) g_target->idx[row + i] = palIndex(src[i - cx]);
+            else if (x1 > x0) copySpan(g_target->px + row + x0, src + (x0 - cx), x1 - x0);
+            cx += len;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Draw list. The world passes record commands instead of rasterizing in call order;
+// drawListFlush sorts them by key (layer, primitive, size, colour, then record order)
+// and replays them, in row bands on the job pool for 32-bit targets. Consecutive
+// commands with the same key run as one batch: sprites share their header and row
+// table lookup, discs and rects their setup. Sorting only reorders within a layer,
+// so anything that must overdraw something else gets a later layer.
+// ---------------------------------------------------------------------------
+enum DrawLayer : uint8_t { DL_CLEAR, DL_FLOOR, DL_WALLS, DL_DOORS, DL_TRIM, DL_ENEMIES, DL_SHOTS, DL_PLAYER };
+enum DrawPrim : uint8_t { DP_CLEAR, DP_RECT, DP_OUTLINE, DP_DISC, DP_SPRITE };
+
+// key: layer:4 | prim:4 | size:24 | colour:32. size is the disc radius in 1/64 px, the
+// rect area, or the sprite id.
+struct DrawCmd {
+    uint64_t key;
+    float x, y, w, h;  // rect: corner and size; disc: centre, radius in w; sprite: corner
+    uint32_t seq;
+    uint32_t pad;
+};
+static_assert(sizeof(DrawCmd) == 32, "DrawCmd should stay two per cache line");
+
+struct DrawList {
+    std::vector<DrawCmd> cmds;
+    std::vector<int> starts; // batch boundaries into cmds, rebuilt by each flush
+    bool immediate = false; // rasterize as recorded (reference path for -bench)
+    uint64_t frames = 0, commands = 0, batches = 0;
+    double sortMs = 0, replayMs = 0;
+};
+static DrawList g_draw;
+
+static DrawPrim cmdPrim(const DrawCmd& c) { return DrawPrim((c.key >> 56) & 15); }
+static uint32_t cmdColor(const DrawCmd& c) { return uint32_t(c.key); }
+
+// Rows [y0, y1) the command can touch.
+static void cmdRows(const DrawCmd& c, int& y0, int& y1) {
+    switch (cmdPrim(c)) {
+    case DP_CLEAR: y0 = INT32_MIN; y1 = INT32_MAX; return;
+    case DP_DISC: y0 = int(std::floor(c.y - c.w - 0.5f)); y1 = int(std::ceil(c.y + c.w + 0.5f)) + 1; return;
+    case DP_SPRITE: y0 = int(c.y); y1 = y0 + spriteH(g_atlas, int((c.key >> 32) & 0xFFFFFF)); return;
+    default: y0 = int(c.y); y1 = int(c.y) + int(c.h); return;
+    }
+}
+
+// Runs n commands sharing one key on the current target.
+static void execBatch(const DrawCmd* c, int n) {
+    uint32_t col = cmdColor(c[0]);
+    switch (cmdPrim(c[0])) {
+    case DP_CLEAR: clear(col); break;
+    case DP_RECT: for (int i = 0; i < n; ++i) fillRect(int(c[i].x), int(c[i].y), int(c[i].w), int(c[i].h), col); break;
+    case DP_OUTLINE: for (int i = 0; i < n; ++i) drawRect(int(c[i].x), int(c[i].y), int(c[i].w), int(c[i].h), col); break;
+    case DP_DISC: for (int i = 0; i < n; ++i) fillCircleAA(c[i].x, c[i].y, c[i].w, col); break;
+    case DP_SPRITE: {
+        int id = int((c[0].key >> 32) & 0xFFFFFF);
+        for (int i = 0; i < n; ++i) blitSprite(g_atlas, id, int(c[i].x), int(c[i].y));
+        break;
+    }
+    }
+}
+
+static void cmdPush(DrawLayer layer, DrawPrim prim, uint32_t size, uint32_t color, float x, float y, float w, float h) {
+    DrawCmd c;
+    c.key = uint64_t(layer) << 60 | uint64_t(prim) << 56 | uint64_t(size & 0xFFFFFF) << 32 | color;
+    c.x = x; c.y = y; c.w = w; c.h = h;
+    c.seq = uint32_t(g_draw.cmds.size());
+    c.pad = 0;
+    if (g_draw.immediate) execBatch(&c, 1);
+    else g_draw.cmds.push_back(c);
+}
+static void cmdClear(uint32_t c) { cmdPush(DL_CLEAR, DP_CLEAR, 0, c, 0, 0, 0, 0); }
+static void cmdRect(DrawLayer l, int x, int y, int w, int h, uint32_t c) {
+    cmdPush(l, DP_RECT, uint32_t(w) * uint32_t(h), c, float(x), float(y), float(w), float(h));
+}
+static void cmdOutline(DrawLayer l, int x, int y, int w, int h, uint32_t c) {
+    cmdPush(l, DP_OUTLINE, uint32_t(w) * uint32_t(h), c, float(x), float(y), float(w), float(h));
+}
+static void cmdDisc(DrawLayer l, float cx, float cy, float r, uint32_t c) {
+    cmdPush(l, DP_DISC, uint32_t(std::lround(r * 64.f)), c, cx, cy, r, 0);
+}
+static void cmdSprite(DrawLayer l, int id, int x, int y) { cmdPush(l, DP_SPRITE, uint32_t(id), 0, float(x), float(y), 0, 0); }
+
+static void drawRoom(Room R) {
+    // walls
+    cmdRect(DL_FLOOR, ROOM_X, ROOM_Y, ROOM_W, ROOM_H, RGBA(20, 20, 25));
+    cmdOutline(DL_WALLS, ROOM_X, ROOM_Y, ROOM_W, ROOM_H, RGBA(200, 200, 200));
+    // doors (closed if uncleared)
+    for (int i = 0; i < 4; ++i) {
+        if (!R.door(i)) continue;
+        RECT rc = doorRect((Dir)i);
+        bool locked = !R.cleared();
+        uint32_t col = locked ? RGBA(180, 60, 60) : RGBA(100, 220, 120);
+        cmdRect(DL_DOORS, rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top, col);
+    }
+    // boss tint
+    if (R.boss()) {
+        // subtle border glow
+        cmdOutline(DL_TRIM, ROOM_X + 3, ROOM_Y + 3, ROOM_W - 6, ROOM_H - 6, RGBA(200, 80, 200));
+    }
+}
+
+#ifndef ISAAC_FIXED_MATH
+static std::vector<float> g_toPx, g_toPy, g_toPd; // per-enemy scratch, grows once
+#endif
+
+static void updateEnemies(Room R, Scalar dt) {
+    EnemySpan en = R.enemies();
+    size_t n = en.size();
+#ifndef ISAAC_FIXED_MATH
+    // direction and distance to the player for every enemy in one batch
+    g_toPx.resize(n); g_toPy.resize(n); g_toPd.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        Vec toP = g_player.p - en[i].p;
+        g_toPx[i] = toP.x; g_toPy[i] = toP.y;
+    }
+    batchNormalize(g_toPx.data(), g_toPy.data(), g_toPd.data(), int(n));
+#endif
+    for (size_t i = 0; i < n; ++i) {
+        Enemy& e = en[i];
+        if (e.dead) continue;
+        e.prev = e.p;
+#ifndef ISAAC_FIXED_MATH
+        Vec dir(g_toPx[i], g_toPy[i]);
+        Scalar d = g_toPd[i];
+#else
         Vec toP = g_player.p - e.p;
-        float d = len(toP);
+        Scalar d = len(toP);
+        Vec dir = d > 0 ? Vec(toP.x / d, toP.y / d) : Vec(0, 0);
+#endif
         if (e.kind == 0) { // chaser
-            Vec dir = norm(toP);
             e.p += dir * e.speed * dt;
         }
         else { // patrol
@@ -316,56 +2326,93 @@ static void updateEnemies(Room& R, float dt) {
             if (e.p.x < ROOM_X + 30 || e.p.x > ROOM_X + ROOM_W - 30) e.patrolDir.x *= -1;
             if (e.p.y < ROOM_Y + 30 || e.p.y > ROOM_Y + ROOM_H - 30) e.patrolDir.y *= -1;
             // occasionally nudge toward player
-            if (d < 180.f) e.p += norm(toP) * (e.speed * 0.4f) * dt;
+            if (d < 180.f) e.p += dir * (e.speed * 0.4f) * dt;
         }
         // collide with walls
-        e.p.x = clamp(e.p.x, float(ROOM_X + 20 + int(e.r)), float(ROOM_X + ROOM_W - 20 - int(e.r)));
-        e.p.y = clamp(e.p.y, float(ROOM_Y + 20 + int(e.r)), float(ROOM_Y + ROOM_H - 20 - int(e.r)));
+        e.p.x = clamp(e.p.x, Scalar(ROOM_X + 20 + int(e.r)), Scalar(ROOM_X + ROOM_W - 20 - int(e.r)));
+        e.p.y = clamp(e.p.y, Scalar(ROOM_Y + 20 + int(e.r)), Scalar(ROOM_Y + ROOM_H - 20 - int(e.r)));
     }
     // cull dead
-    R.enemies.erase(std::remove_if(R.enemies.begin(), R.enemies.end(), [](const Enemy& e) {return e.dead; }), R.enemies.end());
-    if (!R.enemies.empty()) return;
-    R.cleared = true;
+    R.cullDead();
+    if (!R.enemies().empty() || R.cleared()) return;
+    R.markCleared();
+    ++g_clearedVersion;
+    metricAdd(M_ROOMS_CLEARED);
+    sfxPlay(SFX_CLEAR, 0.6f);
 }
 
-static void drawEnemies(const Room& R) {
-    for (auto& e : R.enemies) {
+static void drawEnemies(Room R) {
+    for (auto& e : R.enemies()) {
         uint32_t c = e.kind == 0 ? RGBA(240, 180, 60) : RGBA(120, 200, 255);
         if (e.hp <= 1.f) c = RGBA(255, 120, 120);
-        fillCircle(int(e.p.x), int(e.p.y), int(e.r), c);
+        cmdDisc(DL_ENEMIES, float(e.p.x), float(e.p.y), float(e.r), c);
     }
 }
 
-static void updateBullets(Room& R, float dt) {
+// Earliest fraction t in [0, tMax] of a tick at which a circle starting at offset p
+// (relative to another circle) and moving by d comes within rr of it, or -1 if it
+// doesn't. Solves |p + t d|^2 = rr^2. The bounding-box reject keeps every product
+// small enough for fixed point however far apart the two are.
+static Scalar sweepCircles(const Vec& p, const Vec& d, Scalar rr, Scalar tMax) {
+    Scalar reach = rr + sabs(d.x) + sabs(d.y);
+    if (sabs(p.x) > reach || sabs(p.y) > reach) return -1;
+    Scalar c = dot(p, p) - rr * rr;
+    if (c <= 0) return 0; // already touching
+    Scalar b = dot(p, d), a = dot(d, d);
+    if (b >= 0 || a <= 0) return -1; // not closing in
+    Scalar disc = b * b - a * c;
+    if (disc < 0) return -1;
+    Scalar t = (-b - ssqrt(disc)) / a;
+    return t <= tMax ? t : Scalar(-1);
+}
+
+// Fraction of a move from p by d after which the centre leaves [lo, hi], or 1
+// (0 when it starts outside).
+static Scalar sweepBounds(Scalar p, Scalar d, Scalar lo, Scalar hi) {
+    if (p < lo || p > hi) return 0;
+    if (d > 0 && p + d > hi) return (hi - p) / d;
+    if (d < 0 && p + d < lo) return (lo - p) / d;
+    return 1;
+}
+
+// Bullets are swept over the whole tick against the walls and against each enemy's
+// motion since the start of the tick, so fast shots and low tick rates can't tunnel.
+static void updateBullets(Room R, Scalar dt) {
     for (auto& b : g_player.shots) {
         if (b.dead) continue;
-        b.p += b.v * dt;
+        Vec d = b.v * dt;
+        // the shot ends at the first of: lifetime out, wall reached (the old clamp-as-kill)
+        Scalar tEnd = b.ttl < dt ? b.ttl / dt : Scalar(1);
+        tEnd = std::min(tEnd, sweepBounds(b.p.x, d.x, Scalar(ROOM_X + 20), Scalar(ROOM_X + ROOM_W - 20)));
+        tEnd = std::min(tEnd, sweepBounds(b.p.y, d.y, Scalar(ROOM_Y + 20), Scalar(ROOM_Y + ROOM_H - 20)));
+        // hit the enemy it reaches first
+        Enemy* hit = nullptr;
+        Scalar tHit = tEnd;
+        for (auto& e : R.enemies()) {
+            if (e.dead) continue;
+            Scalar t = sweepCircles(b.p - e.prev, d - (e.p - e.prev), b.r + e.r, tHit);
+            if (t >= 0) { hit = &e; tHit = t; }
+        }
+        b.p += d * tHit;
         b.ttl -= dt;
-        if (b.ttl <= 0) b.dead = true;
-        // wall bounce (simple clamp as kill)
-        if (b.p.x<ROOM_X + 20 || b.p.x>ROOM_X + ROOM_W - 20 || b.p.y<ROOM_Y + 20 || b.p.y>ROOM_Y + ROOM_H - 20)
+        if (hit) {
+            hit->hp -= 1.f;
             b.dead = true;
-        // hit enemies
-        for (auto& e : R.enemies) {
-            if (e.dead) continue;
-            float dx = b.p.x - e.p.x, dy = b.p.y - e.p.y;
-            float rr = (b.r + e.r); rr *= rr;
-            if (dx * dx + dy * dy <= rr) {
-                e.hp -= 1.f;
-                b.dead = true;
-                if (e.hp <= 0) e.dead = true;
-                break;
-            }
+            sfxPlay(SFX_HIT, 0.5f, panAt(float(hit->p.x)));
+            g_screenFx.shake = std::max(g_screenFx.shake, 0.45f);
+            if (hit->hp <= 0) { hit->dead = true; metricAdd(M_KILLS); }
         }
+        else if (tEnd < 1 || b.ttl <= 0) b.dead = true;
     }
     g_player.shots.erase(std::remove_if(g_player.shots.begin(), g_player.shots.end(), [](const Bullet& b) {return b.dead; }), g_player.shots.end());
 }
 static void drawBullets() {
-    for (auto& b : g_player.shots) fillCircle(int(b.p.x), int(b.p.y), int(b.r), RGBA(255, 255, 255));
+    int half = spriteW(g_atlas, SPR_BULLET) / 2;
+    for (auto& b : g_player.shots) cmdSprite(DL_SHOTS, SPR_BULLET, int(b.p.x) - half, int(b.p.y) - half);
 }
 
 static void drawPlayer() {
-    fillCircle(int(g_player.p.x), int(g_player.p.y), int(g_player.r), RGBA(180, 220, 255));
+    cmdDisc(DL_PLAYER, float(g_player.p.x), float(g_player.p.y), float(g_player.r), RGBA(180, 220, 255));
     // tiny "eye" to suggest facing based on last shot or movement could be added
 }
 
@@ -377,60 +2424,68 @@ static void playerShoot(const Vec& dir) {
     b.r = 5.f;
     b.ttl = 0.9f;
     g_player.shots.push_back(b);
+    metricAdd(M_SHOTS);
     g_player.shotCooldown = 0.12f; // fire rate
+    sfxPlay(SFX_SHOOT, 0.3f, panAt(float(g_player.p.x)));
 }
 
-static void playerUpdateMove(float dt) {
+static void playerUpdateMove(Scalar dt) {
     Vec mv(0, 0);
-    if (keyDown('W')) mv.y -= 1;
-    if (keyDown('S')) mv.y += 1;
-    if (keyDown('A')) mv.x -= 1;
-    if (keyDown('D')) mv.x += 1;
+    if (tickKey('W')) mv.y -= 1;
+    if (tickKey('S')) mv.y += 1;
+    if (tickKey('A')) mv.x -= 1;
+    if (tickKey('D')) mv.x += 1;
     if (mv.x != 0 || mv.y != 0) mv = norm(mv);
     g_player.p += mv * g_player.speed * dt;
 
     // clamp to inner room (leave holes where doors are? keep simple; doors are overlays)
-    g_player.p.x = clamp(g_player.p.x, float(ROOM_X + 20 + int(g_player.r)), float(ROOM_X + ROOM_W - 20 - int(g_player.r)));
-    g_player.p.y = clamp(g_player.p.y, float(ROOM_Y + 20 + int(g_player.r)), float(ROOM_Y + ROOM_H - 20 - int(g_player.r)));
+    g_player.p.x = clamp(g_player.p.x, Scalar(ROOM_X + 20 + int(g_player.r)), Scalar(ROOM_X + ROOM_W - 20 - int(g_player.r)));
+    g_player.p.y = clamp(g_player.p.y, Scalar(ROOM_Y + 20 + int(g_player.r)), Scalar(ROOM_Y + ROOM_H - 20 - int(g_player.r)));
 }
 
 static void playerShootInput() {
     Vec d(0, 0);
-    if (keyDown(VK_UP))    d.y -= 1;
-    if (keyDown(VK_DOWN))  d.y += 1;
-    if (keyDown(VK_LEFT))  d.x -= 1;
-    if (keyDown(VK_RIGHT)) d.x += 1;
+    if (tickKey(VK_UP))    d.y -= 1;
+    if (tickKey(VK_DOWN))  d.y += 1;
+    if (tickKey(VK_LEFT))  d.x -= 1;
+    if (tickKey(VK_RIGHT)) d.x += 1;
     if (d.x != 0 || d.y != 0) playerShoot(norm(d));
 }
 
-static void playerHitCheck(Room& R, float dt) {
+static void playerHitCheck(Room R, Scalar dt) {
     // touch damage if overlapping enemies
-    for (auto& e : R.enemies) {
+    for (auto& e : R.enemies()) {
         if (e.dead) continue;
-        float dx = g_player.p.x - e.p.x, dy = g_player.p.y - e.p.y;
-        float rr = (g_player.r + e.r); rr *= rr;
+        Scalar dx = g_player.p.x - e.p.x, dy = g_player.p.y - e.p.y;
+        Scalar rr = (g_player.r + e.r); rr *= rr;
         if (dx * dx + dy * dy <= rr) {
             // blink damage: simple cooldown by moving player a bit and subtract hp once per overlap window
-            static float hurtCD = 0.f;
+            static Scalar hurtCD = 0.f;
             if (hurtCD <= 0.f) {
                 g_player.hp -= 1;
                 hurtCD = 0.9f;
+                sfxPlay(SFX_HURT, 0.7f, panAt(float(g_player.p.x)));
+                g_screenFx.flash = 1.f;
+                g_screenFx.shake = 1.f;
                 // knockback
                 Vec kb = norm(g_player.p - e.p);
                 g_player.p += kb * 20.f;
                 if (g_player.hp <= 0) { g_runOver = true; }
             }
             // tick cooldown
-            hurtCD = std::max(0.f, hurtCD - dt);
+            hurtCD = std::max(Scalar(0.f), hurtCD - dt);
         }
     }
 }
 
-static void handleDoorsAndTransitions(Room& R) {
-    if (!R.cleared) return;
+static void handleDoorsAndTransitions(Room R) {
+    if (!R.cleared()) return;
 
+    // generation only opens doors between rooms; the neighbour is still checked so a
+    // stray door bit cannot move the player off the grid or into an empty cell
     auto tryGo = [&](Dir d, int nx, int ny, Vec newPos) {
-        if (!R.doors[(int)d]) return false;
+        if (!R.door((int)d)) return false;
+        if (nx < 0 || ny < 0 || nx >= g_floor.w || ny >= g_floor.h || !g_floor.exists.test(g_floor.cell(nx, ny))) return false;
         RECT rc = doorRect(d);
 
         // expand door hitbox to make overlap easier
@@ -444,117 +2499,3446 @@ static void handleDoorsAndTransitions(Room& R) {
         return false;
         };
 
-    if (R.doors[(int)Dir::Up] && g_ry > 0 && g_dungeon[g_ry - 1][g_rx].exists)
-        if (tryGo(Dir::Up, g_rx, g_ry - 1, Vec(ROOM_X + ROOM_W / 2.f, ROOM_Y + ROOM_H - 60))) return;
+    if (tryGo(Dir::Up, g_rx, g_ry - 1, Vec(ROOM_X + ROOM_W / 2.f, ROOM_Y + ROOM_H - 60))) return;
+    if (tryGo(Dir::Down, g_rx, g_ry + 1, Vec(ROOM_X + ROOM_W / 2.f, ROOM_Y + 60))) return;
+    if (tryGo(Dir::Left, g_rx - 1, g_ry, Vec(ROOM_X + ROOM_W - 60, ROOM_Y + ROOM_H / 2.f))) return;
+    if (tryGo(Dir::Right, g_rx + 1, g_ry, Vec(ROOM_X + 60, ROOM_Y + ROOM_H / 2.f))) return;
+}
+
 
-    if (R.doors[(int)Dir::Down] && g_ry < GRID_H - 1 && g_dungeon[g_ry + 1][g_rx].exists)
-        if (tryGo(Dir::Down, g_rx, g_ry + 1, Vec(ROOM_X + ROOM_W / 2.f, ROOM_Y + 60))) return;
+static void checkAllCleared() {
+    g_allCleared = g_floor.anyRoom() && !g_floor.anyUncleared();
+    if (g_allCleared && !g_runOver) {
+        if (g_descent.on) descend();
+        else g_runOver = true; // floor done
+    }
+}
 
-    if (R.doors[(int)Dir::Left] && g_rx > 0 && g_dungeon[g_ry][g_rx - 1].exists)
-        if (tryGo(Dir::Left, g_rx - 1, g_ry, Vec(ROOM_X + ROOM_W - 60, ROOM_Y + ROOM_H / 2.f))) return;
+static void simulateTick(float frameDt) {
+    metricAdd(M_TICKS);
+    inputTick();
+    screenFxTick(frameDt);
+    if (g_runOver) return;
+    Scalar dt = frameDt;
+    Room R = currentRoom();
+    // input
+    playerUpdateMove(dt);
+    playerShootInput();
+    if (g_player.shotCooldown > 0.f) g_player.shotCooldown -= dt;
 
-    if (R.doors[(int)Dir::Right] && g_rx < GRID_W - 1 && g_dungeon[g_ry][g_rx + 1].exists)
-        if (tryGo(Dir::Right, g_rx + 1, g_ry, Vec(ROOM_X + 60, ROOM_Y + ROOM_H / 2.f))) return;
+    // systems
+    { ProfZone zone(PZ_ENEMIES, R.enemies().size()); updateEnemies(R, dt); }
+    { ProfZone zone(PZ_BULLETS, g_player.shots.size()); updateBullets(R, dt); }
+    { ProfZone zone(PZ_HITS, R.enemies().size()); playerHitCheck(R, dt); }
+    handleDoorsAndTransitions(R);
+    checkAllCleared();
+    if (g_player.hp <= 0) g_runOver = true;
 }
 
+// ---------------------------------------------------------------------------
+// Job pool: persistent workers that split an index range with the calling thread.
+// One batch runs at a time; a caller that finds the pool busy runs its batch
+// inline instead of waiting, so the game thread never queues behind a background
+// encoder.
+// ---------------------------------------------------------------------------
+struct JobPool {
+    std::vector<std::thread> workers;
+    std::mutex busy, m;
+    std::condition_variable cv, doneCv;
+    const std::function<void(int)>* fn = nullptr;
+    int count = 0;
+    std::atomic<int> next{ 0 };
+    int pending = 0;          // workers still inside the current batch
+    uint64_t batch = 0;
+    bool quit = false;
+};
+static JobPool g_jobs;
 
-static void checkAllCleared() {
-    bool any = false, allclear = true;
-    for (int y = 0; y < GRID_H; ++y) for (int x = 0; x < GRID_W; ++x) {
-        if (!g_dungeon[y][x].exists) continue;
-        any = true;
-        if (!g_dungeon[y][x].cleared) allclear = false;
+static void jobWorker(JobPool& P) {
+    uint64_t seen = 0;
+    for (;;) {
+        std::unique_lock<std::mutex> lk(P.m);
+        P.cv.wait(lk, [&] { return P.quit || P.batch != seen; });
+        if (P.quit) return;
+        seen = P.batch;
+        const std::function<void(int)>& fn = *P.fn;
+        int n = P.count;
+        lk.unlock();
+        for (int i; (i = P.next.fetch_add(1)) < n;) fn(i);
+        lk.lock();
+        if (--P.pending == 0) P.doneCv.notify_one();
     }
-    g_allCleared = any && allclear;
-    if (g_allCleared && !g_runOver) {
-        g_runOver = true; // floor done
+}
+static int jobThreads() { return int(g_jobs.workers.size()) + 1; }
+static void jobsStart() {
+    int n = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+    for (int i = 0; i < n; ++i) g_jobs.workers.emplace_back(jobWorker, std::ref(g_jobs));
+}
+static void jobsStop() {
+    { std::lock_guard<std::mutex> lk(g_jobs.m); g_jobs.quit = true; }
+    g_jobs.cv.notify_all();
+    for (auto& t : g_jobs.workers) t.join();
+    g_jobs.workers.clear();
+    g_jobs.quit = false;
+}
+// Runs fn(0..n-1) across the pool and returns when all indices are done.
+static void parallelFor(int n, const std::function<void(int)>& fn) {
+    JobPool& P = g_jobs;
+    if (n <= 1 || P.workers.empty() || !P.busy.try_lock()) {
+        for (int i = 0; i < n; ++i) fn(i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(P.m);
+        P.fn = &fn; P.count = n; P.next = 0;
+        P.pending = int(P.workers.size());
+        ++P.batch;
     }
+    P.cv.notify_all();
+    for (int i; (i = P.next.fetch_add(1)) < n;) fn(i);
+    {
+        std::unique_lock<std::mutex> lk(P.m);
+        P.doneCv.wait(lk, [&] { return P.pending == 0; });
+    }
+    P.busy.unlock();
 }
 
-static LRESULT CALLBACK WndProc(HWND h, UINT m, WPARAM w, LPARAM l) {
-    if (m == WM_DESTROY) { g_running = false; PostQuitMessage(0); return 0; }
-    return DefWindowProc(h, m, w, l);
+// ---------------------------------------------------------------------------
+// Lighting: point lights (player, shots, boss-room enemies) accumulated into a float
+// RGB lightmap at 1/LIGHT_SCALE resolution, then bilinearly upsampled and multiplied
+// into the world layer (before the HUD) in one SSE2 (or AVX2) pass per row. Light is
+// in units of the unlit colour: 1 leaves a pixel unchanged, the ambient level darkens
+// and values up to 2 brighten. Both steps split rows across the job pool.
+// ---------------------------------------------------------------------------
+static const int LIGHT_SCALE = 4;
+static const int LIGHT_W = WIDTH / LIGHT_SCALE, LIGHT_H = HEIGHT / LIGHT_SCALE;
+static_assert(LIGHT_SCALE == 4 && LIGHT_W % 4 == 0, "the composite interpolates 4 pixels per cell");
+
+struct Light { float x, y, radius, r, g, b; };
+struct Lightmap {
+    std::vector<float> r, g, b; // LIGHT_W x LIGHT_H planes
+    std::vector<float> q;       // intensity of the light run being accumulated
+    std::vector<Light> lights;
+    float ambient = 0.55f;
+};
+static Lightmap g_light;
+
+static void lightGather(Room R) {
+    std::vector<Light>& L = g_light.lights;
+    L.clear();
+    L.push_back({ float(g_player.p.x), float(g_player.p.y), 170.f, 0.75f, 0.65f, 0.5f });
+    for (const Bullet& b : g_player.shots) L.push_back({ float(b.p.x), float(b.p.y), 48.f, 0.5f, 0.55f, 0.7f });
+    if (R.boss()) for (const Enemy& e : R.enemies()) L.push_back({ float(e.p.x), float(e.p.y), 110.f, 0.9f, 0.2f, 0.45f });
 }
 
-int APIENTRY WinMain(HINSTANCE hInst, HINSTANCE, LPSTR, int) {
-    // Window
-    WNDCLASS wc{}; wc.lpszClassName = TEXT("IsaacLikeWin"); wc.hInstance = hInst; wc.lpfnWndProc = WndProc; wc.hCursor = LoadCursor(NULL, IDC_ARROW);
-    RegisterClass(&wc);
-    DWORD style = WS_OVERLAPPEDWINDOW & ~(WS_MAXIMIZEBOX | WS_THICKFRAME);
-    HWND hwnd = CreateWindow(wc.lpszClassName, TEXT("Mini Isaac-like (No Sprites)"),
-        style, CW_USEDEFAULT, CW_USEDEFAULT, WIDTH + 16, HEIGHT + 39, nullptr, nullptr, hInst, nullptr);
-    ShowWindow(hwnd, SW_SHOW);
+// Calls add(k, t) with the (1 - d^2/radius^2)^2 falloff t of light l for cells k..k+3
+// of the lightmap, over the chord of its disc on each of rows [j0, j1).
+template<typename Add> static void lightFalloff(const Light& l, int j0, int j1, Add add) {
+    const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), scale = _mm_set1_ps(float(LIGHT_SCALE));
+    float r2 = l.radius * l.radius;
+    int jl = std::max(j0, int((l.y - l.radius) / LIGHT_SCALE)), jh = std::min(j1, int((l.y + l.radius) / LIGHT_SCALE) + 1);
+    if (jl >= jh || l.x + l.radius < 0 || l.x - l.radius >= WIDTH) return;
+    __m128 inv = _mm_set1_ps(1.f / r2), one = _mm_set1_ps(1.f), zero = _mm_setzero_ps(), lx = _mm_set1_ps(l.x);
+    const __m128 step = _mm_set1_ps(4.f * LIGHT_SCALE);
+    for (int j = jl; j < jh; ++j) {
+        float dy = (j + 0.5f) * LIGHT_SCALE - l.y;
+        if (dy * dy >= r2) continue;
+        float half = std::sqrt(r2 - dy * dy); // chord of the light's disc on this row
+        int il = std::max(0, int((l.x - half) / LIGHT_SCALE)) & ~3, ih = std::min(LIGHT_W, (int((l.x + half) / LIGHT_SCALE) + 4) & ~3);
+        __m128 dy2 = _mm_set1_ps(dy * dy);
+        __m128 dx = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(il)), lanes), scale), lx);
+        for (int i = il; i < ih; i += 4, dx = _mm_add_ps(dx, step)) {
+            __m128 t = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2), inv)), zero);
+            add(j * LIGHT_W + i, _mm_mul_ps(t, t));
+        }
+    }
+}
 
-    // Backbuffer
-    g_bmpInfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    g_bmpInfo.bmiHeader.biWidth = WIDTH;
-    g_bmpInfo.bmiHeader.biHeight = -HEIGHT; // top-down
-    g_bmpInfo.bmiHeader.biPlanes = 1;
-    g_bmpInfo.bmiHeader.biBitCount = 32;
-    g_bmpInfo.bmiHeader.biCompression = BI_RGB;
+// Fills lightmap rows [j0, j1) with the ambient level plus every light's falloff, 4
+// cells at a time. lightGather emits lights of one colour back to back (all shots, all
+// boss enemies); each such run adds into the single intensity plane q, which is then
+// folded into r, g and b once, so a light costs one read-modify-write instead of three.
+static void lightAccumulate(int j0, int j1) {
+    Lightmap& M = g_light;
+    const int k0 = j0 * LIGHT_W, k1 = j1 * LIGHT_W;
+    std::fill(M.r.begin() + k0, M.r.begin() + k1, M.ambient);
+    std::fill(M.g.begin() + k0, M.g.begin() + k1, M.ambient);
+    std::fill(M.b.begin() + k0, M.b.begin() + k1, M.ambient);
+    float* pr = M.r.data(); float* pg = M.g.data(); float* pb = M.b.data(); float* pq = M.q.data();
+    const std::vector<Light>& L = M.lights;
+    for (size_t s = 0, e; s < L.size(); s = e) {
+        const Light& l = L[s];
+        for (e = s + 1; e < L.size() && L[e].r == l.r && L[e].g == l.g && L[e].b == l.b;) ++e;
+        __m128 cr = _mm_set1_ps(l.r), cg = _mm_set1_ps(l.g), cb = _mm_set1_ps(l.b);
+        if (e - s == 1) {
+            lightFalloff(l, j0, j1, [&](int k, __m128 t) {
+                _mm_storeu_ps(pr + k, _mm_add_ps(_mm_loadu_ps(pr + k), _mm_mul_ps(t, cr)));
+                _mm_storeu_ps(pg + k, _mm_add_ps(_mm_loadu_ps(pg + k), _mm_mul_ps(t, cg)));
+                _mm_storeu_ps(pb + k, _mm_add_ps(_mm_loadu_ps(pb + k), _mm_mul_ps(t, cb)));
+            });
+            continue;
+        }
+        std::fill(M.q.begin() + k0, M.q.begin() + k1, 0.f);
+        for (size_t n = s; n < e; ++n)
+            lightFalloff(L[n], j0, j1, [&](int k, __m128 t) { _mm_storeu_ps(pq + k, _mm_add_ps(_mm_loadu_ps(pq + k), t)); });
+        for (int k = k0; k < k1; k += 4) {
+            __m128 t = _mm_loadu_ps(pq + k);
+            _mm_storeu_ps(pr + k, _mm_add_ps(_mm_loadu_ps(pr + k), _mm_mul_ps(t, cr)));
+            _mm_storeu_ps(pg + k, _mm_add_ps(_mm_loadu_ps(pg + k), _mm_mul_ps(t, cg)));
+            _mm_storeu_ps(pb + k, _mm_add_ps(_mm_loadu_ps(pb + k), _mm_mul_ps(t, cb)));
+        }
+    }
+}
 
-    HDC hdc = GetDC(hwnd);
-    HDC memDC = CreateCompatibleDC(hdc);
-    HBITMAP dib = CreateDIBSection(hdc, &g_bmpInfo, DIB_RGB_COLORS, &g_pixels, NULL, 0);
-    SelectObject(memDC, dib);
+// Lightmap row j as 16-bit (r, g, b, 256) weights per cell, 256 = unlit colour, capped
+// at 512. Weights are stored in the framebuffer's byte order so the multiply is
+// format-agnostic.
+static void lightCells(int j, uint16_t* cells) {
+    const __m128 k256 = _mm_set1_ps(256.f), k512 = _mm_set1_ps(512.f);
+    const __m128i alpha = _mm_set1_epi32(256);
+    for (int i = 0; i < LIGHT_W; i += 4) {
+        auto weight = [&](const std::vector<float>& P) {
+            return _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(&P[j * LIGHT_W + i]), k256), k512));
+        };
+        // channel weights in framebuffer byte order: c0 is blue for BGRA8, red for RGBA8
+        __m128i rg = _mm_packs_epi32(weight(FB_SHIFT_R ? g_light.b : g_light.r), weight(g_light.g)); // c0 x4, g x4
+        __m128i ba = _mm_packs_epi32(weight(FB_SHIFT_R ? g_light.r : g_light.b), alpha);
+        __m128i t1 = _mm_unpacklo_epi16(rg, _mm_unpackhi_epi64(rg, rg)); // c0 g c0 g ..
+        __m128i t2 = _mm_unpacklo_epi16(ba, _mm_unpackhi_epi64(ba, ba)); // c2 a c2 a ..
+        _mm_store_si128((__m128i*)&cells[i * 4], _mm_unpacklo_epi32(t1, t2));
+        _mm_store_si128((__m128i*)&cells[i * 4 + 8], _mm_unpackhi_epi32(t1, t2));
+    }
+}
 
-    // Game init
-    resetRun();
+// Multiplies framebuffer rows [y0, y1) by the bilinearly upsampled lightmap. With 4
+// pixels per cell, pixel k of a cell always sits at fraction (2k + 1) / 8 between two
+// cells, in both directions, so every weight is a + ((b - a) * (2k + 1) >> 3) on 16-bit
+// cell weights: lightmap rows are converted once each, blended per framebuffer row,
+// and each cell's blend is spread over its 4 pixels. AVX2 builds do two cells per step.
+static void lightComposite(int y0, int y1) {
+    alignas(16) uint16_t rowA[LIGHT_W * 4], rowB[LIGHT_W * 4], cells[LIGHT_W * 4];
+    int ja = -1, jb = -1; // lightmap rows held in rowA / rowB
+    const __m128i z = _mm_setzero_si128();
+    const __m128i f13 = _mm_setr_epi16(1, 1, 1, 1, 3, 3, 3, 3), f57 = _mm_setr_epi16(5, 5, 5, 5, 7, 7, 7, 7);
+    auto applyCell = [](uint32_t* px, int n, const uint16_t* w) { // edge pixels
+        for (int k = 0; k < n; ++k) {
+            uint32_t c = px[k], out = 0;
+            for (int ch = 0; ch < 4; ++ch) out |= uint32_t(std::min(255u, (((c >> (ch * 8)) & 255) * w[ch]) >> 8)) << (ch * 8);
+            px[k] = out;
+        }
+    };
+    for (int y = y0; y < y1; ++y) {
+        int j = (y - LIGHT_SCALE / 2) >> 2; // floor((y + 0.5) / 4 - 0.5)
+        int a = clamp(j, 0, LIGHT_H - 1), b = clamp(j + 1, 0, LIGHT_H - 1);
+        if (a != ja) {
+            if (a == jb) memcpy(rowA, rowB, sizeof(rowA));
+            else lightCells(a, rowA);
+            ja = a;
+        }
+        if (b != jb) { lightCells(b, rowB); jb = b; }
+        __m128i f = _mm_set1_epi16(int16_t(2 * ((y - LIGHT_SCALE / 2) & 3) + 1));
+        for (int i = 0; i < LIGHT_W * 4; i += 8) {
+            __m128i va = _mm_load_si128((const __m128i*)&rowA[i]), vb = _mm_load_si128((const __m128i*)&rowB[i]);
+            _mm_store_si128((__m128i*)&cells[i], _mm_add_epi16(va, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(vb, va), f), 3)));
+        }
+        uint32_t* row = g_fb.px + size_t(y) * WIDTH;
+        applyCell(row, 2, cells);
+        int i = 0;
+#ifdef __AVX2__
+        const __m256i z8 = _mm256_setzero_si256();
+        const __m256i f13x2 = _mm256_setr_epi16(1, 1, 1, 1, 3, 3, 3, 3, 1, 1, 1, 1, 3, 3, 3, 3);
+        const __m256i f57x2 = _mm256_setr_epi16(5, 5, 5, 5, 7, 7, 7, 7, 5, 5, 5, 5, 7, 7, 7, 7);
+        for (; i + 2 < LIGHT_W; i += 2) {
+            __m256i c = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&cells[i * 4])),
+                _mm_loadu_si128((const __m128i*)&cells[i * 4 + 4]), 1); // c0 c1 | c1 c2
+            __m256i c00 = _mm256_unpacklo_epi64(c, c), d = _mm256_sub_epi16(_mm256_unpackhi_epi64(c, c), c00);
+            __m256i wA = _mm256_add_epi16(c00, _mm256_srai_epi16(_mm256_mullo_epi16(d, f13x2), 3));
+            __m256i wB = _mm256_add_epi16(c00, _mm256_srai_epi16(_mm256_mullo_epi16(d, f57x2), 3));
+            uint32_t* px = row + i * 4 + 2;
+            __m256i p = _mm256_loadu_si256((const __m256i*)px);
+            __m256i lo = _mm256_mulhi_epu16(_mm256_unpacklo_epi8(z8, p), wA);
+            __m256i hi = _mm256_mulhi_epu16(_mm256_unpackhi_epi8(z8, p), wB);
+            _mm256_storeu_si256((__m256i*)px, _mm256_packus_epi16(lo, hi));
+        }
+#endif
+        for (; i + 1 < LIGHT_W; ++i) {
+            __m128i c0 = _mm_loadl_epi64((const __m128i*)&cells[i * 4]), c1 = _mm_loadl_epi64((const __m128i*)&cells[i * 4 + 4]);
+            __m128i c00 = _mm_unpacklo_epi64(c0, c0), d = _mm_sub_epi16(_mm_unpacklo_epi64(c1, c1), c00);
+            __m128i wA = _mm_add_epi16(c00, _mm_srai_epi16(_mm_mullo_epi16(d, f13), 3));
+            __m128i wB = _mm_add_epi16(c00, _mm_srai_epi16(_mm_mullo_epi16(d, f57), 3));
+            uint32_t* px = row + i * 4 + 2;
+            __m128i p = _mm_loadu_si128((const __m128i*)px);
+            __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(z, p), wA); // (p << 8) * w >> 16
+            __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(z, p), wB);
+            _mm_storeu_si128((__m128i*)px, _mm_packus_epi16(lo, hi));
+        }
+        applyCell(row + WIDTH - 2, 2, cells + (LIGHT_W - 1) * 4);
+    }
+}
 
-    LARGE_INTEGER freq, t0; QueryPerformanceFrequency(&freq); QueryPerformanceCounter(&t0);
-    double acc = 0.0, dt = 1.0 / 120.0; // update at 120 Hz
-    MSG msg{};
-    while (g_running) {
-        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
-            if (msg.message == WM_QUIT) g_running = false;
-            TranslateMessage(&msg); DispatchMessage(&msg);
+// Accumulates and composites the current light list.
+static void lightRun() {
+    g_light.r.resize(size_t(LIGHT_W) * LIGHT_H);
+    g_light.g.resize(g_light.r.size());
+    g_light.b.resize(g_light.r.size());
+    g_light.q.resize(g_light.r.size());
+    int bands = std::min(LIGHT_H, jobThreads() * 2);
+    parallelFor(bands, [&](int k) { lightAccumulate(LIGHT_H * k / bands, LIGHT_H * (k + 1) / bands); });
+    parallelFor(bands, [&](int k) { lightComposite(HEIGHT * k / bands, HEIGHT * (k + 1) / bands); });
+}
+static void lightApply(Room R) {
+    lightGather(R);
+    ProfZone zone(PZ_LIGHT, g_light.lights.size());
+    lightRun();
+}
+
+// ---------------------------------------------------------------------------
+// Post-processing: full-screen passes over the finished frame (screen shake, damage
+// flash, vignette, optional CRT scanlines), each split into row bands on the job
+// pool. Every pass keeps a moving average of its cost; when the sum over the passes
+// that ran this frame exceeds the budget the least important of them drops to half
+// resolution (where it has one) or off, and passes come back one at a time once there
+// is headroom. Shake and flash only run while active and scanlines only with -crt, so
+// an idle pass neither counts toward the budget nor gets dropped.
+// ---------------------------------------------------------------------------
+enum PostPass { POST_SHAKE, POST_FLASH, POST_VIGNETTE, POST_SCANLINES, POST_COUNT };
+enum class PostLevel { Full, Half, Off };
+static const char* POST_NAMES[POST_COUNT] = { "shake", "flash", "vignette", "scanlines" };
+static const bool POST_HAS_HALF[POST_COUNT] = { false, false, true, true };
+static const int POST_SETTLE = 30;  // frames between two level changes
+static const int POST_CALM = 120;   // frames under half the budget before restoring a pass
+
+struct PostFx {
+    bool crt = false;
+    double budgetMs = 1.5;
+    PostLevel level[POST_COUNT] = {};
+    double costMs[POST_COUNT] = {};       // moving average while the pass runs
+    bool ran[POST_COUNT] = {};            // pass ran this frame (set by postTimed)
+    int settle = 0, calm = 0;
+    std::vector<uint32_t> scratch;        // shake source copy
+    std::vector<uint16_t> vigCol, vigColHalf; // vignette falloff per column and per column pair, 0..89
+};
+static PostFx g_post;
+
+// Runs rows(y0, y1) over bands of the frame in parallel.
+static void postBands(const std::function<void(int, int)>& rows) {
+    int bands = std::min(HEIGHT, jobThreads() * 2);
+    parallelFor(bands, [&](int b) { rows(HEIGHT * b / bands, HEIGHT * (b + 1) / bands); });
+}
+// Runs one pass and folds its time into the pass's moving average.
+static void postTimed(int pass, const std::function<void()>& fn) {
+    double t0 = nowSeconds();
+    fn();
+    double ms = (nowSeconds() - t0) * 1e3;
+    g_post.costMs[pass] = g_post.costMs[pass] > 0 ? g_post.costMs[pass] * 0.9 + ms * 0.1 : ms;
+    g_post.ran[pass] = true;
+}
+
+// px * w / 256 per channel for 4 pixels with 16-bit weights (each repeated over a pixel's 4 lanes).
+static inline __m128i scale4(__m128i px, __m128i wLo, __m128i wHi) {
+    __m128i z = _mm_setzero_si128();
+    __m128i lo = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpacklo_epi8(px, z), 8), wLo);
+    __m128i hi = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpackhi_epi8(px, z), 8), wHi);
+    return _mm_packus_epi16(lo, hi);
+}
+
+static void postBuildVignette() {
+    g_post.vigCol.resize(WIDTH);
+    g_post.vigColHalf.resize(WIDTH / 2);
+    for (int x = 0; x < WIDTH; ++x) {
+        float nx = (x + 0.5f) / WIDTH * 2.f - 1.f;
+        g_post.vigCol[x] = uint16_t(nx * nx * 0.35f * 256.f);
+    }
+    for (int x = 0; x < WIDTH / 2; ++x) g_post.vigColHalf[x] = g_post.vigCol[x * 2];
+}
+
+// Weight at (x, y) is 256 * (1 - 0.35 (nx^2 + ny^2)): a row term minus the column table.
+static void postVignette(int y0, int y1, bool half) {
+    for (int y = y0; y < y1; ++y) {
+        int sy = half ? y & ~1 : y;
+        float ny = (sy + 0.5f) / HEIGHT * 2.f - 1.f;
+        __m128i base = _mm_set1_epi16(short(256.f - ny * ny * 0.35f * 256.f));
+        uint32_t* row = g_fb.px + size_t(y) * WIDTH;
+        if (!half) {
+            for (int x = 0; x < WIDTH; x += 4) {
+                __m128i w = _mm_sub_epi16(base, _mm_loadl_epi64((const __m128i*)&g_post.vigCol[x])); // w0..w3
+                w = _mm_unpacklo_epi16(w, w);
+                __m128i px = _mm_loadu_si128((const __m128i*)(row + x));
+                _mm_storeu_si128((__m128i*)(row + x), scale4(px, _mm_unpacklo_epi32(w, w), _mm_unpackhi_epi32(w, w)));
+            }
+        }
+        else { // one weight per 2x2 block
+            for (int x = 0; x < WIDTH; x += 4) {
+                int pair;
+                memcpy(&pair, &g_post.vigColHalf[x / 2], 4);
+                __m128i w = _mm_sub_epi16(base, _mm_cvtsi32_si128(pair)); // w0 w1
+                w = _mm_unpacklo_epi16(w, w);
+                w = _mm_unpacklo_epi32(w, w); // w0 x4, w1 x4
+                __m128i px = _mm_loadu_si128((const __m128i*)(row + x));
+                _mm_storeu_si128((__m128i*)(row + x), scale4(px, w, w));
+            }
         }
-        if (!g_running) break;
+    }
+}
 
-        if (keyDown(VK_ESCAPE)) { g_running = false; break; }
-        if (g_runOver && keyDown('R')) { resetRun(); }
+static void postFlash(int y0, int y1, float strength) {
+    __m128i c16 = _mm_unpacklo_epi8(_mm_set1_epi32(int(RGBA(255, 40, 40))), _mm_setzero_si128());
+    __m128i a = _mm_set1_epi16(short(strength * 512.f)), z = _mm_setzero_si128();
+    for (int y = y0; y < y1; ++y) {
+        uint32_t* row = g_fb.px + size_t(y) * WIDTH;
+        for (int x = 0; x < WIDTH; x += 4) {
+            __m128i d = _mm_loadu_si128((const __m128i*)(row + x));
+            __m128i lo = _mm_unpacklo_epi8(d, z), hi = _mm_unpackhi_epi8(d, z);
+            lo = _mm_add_epi16(lo, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(c16, lo), 7), a));
+            hi = _mm_add_epi16(hi, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(c16, hi), 7), a));
+            _mm_storeu_si128((__m128i*)(row + x), _mm_packus_epi16(lo, hi));
+        }
+    }
+}
 
-        LARGE_INTEGER t1; QueryPerformanceCounter(&t1);
-        double elapsed = double(t1.QuadPart - t0.QuadPart) / double(freq.QuadPart);
-        t0 = t1; acc += elapsed;
+// Every other row at 3/4 brightness; at half resolution, every fourth.
+static void postScanlines(int y0, int y1, bool half) {
+    __m128i w = _mm_set1_epi16(192);
+    for (int y = y0; y < y1; ++y) {
+        if ((y & (half ? 3 : 1)) != 1) continue;
+        uint32_t* row = g_fb.px + size_t(y) * WIDTH;
+        for (int x = 0; x < WIDTH; x += 4) {
+            __m128i px = _mm_loadu_si128((const __m128i*)(row + x));
+            _mm_storeu_si128((__m128i*)(row + x), scale4(px, w, w));
+        }
+    }
+}
 
-        // fixed update loop
-        while (acc >= dt) {
-            acc -= dt;
-            if (!g_runOver) {
-                Room& R = g_dungeon[g_ry][g_rx];
-                // input
-                playerUpdateMove((float)dt);
-                playerShootInput();
-                if (g_player.shotCooldown > 0.f) g_player.shotCooldown -= (float)dt;
-
-                // systems
-                updateEnemies(R, (float)dt);
-                updateBullets(R, (float)dt);
-                playerHitCheck(R, (float)dt);
-                handleDoorsAndTransitions(R);
-                checkAllCleared();
-                if (g_player.hp <= 0) g_runOver = true;
+// Drops or restores at most one pass level per POST_SETTLE frames.
+static void postAdjust() {
+    double total = 0;
+    for (int p = 0; p < POST_COUNT; ++p) if (g_post.ran[p]) total += g_post.costMs[p];
+    g_post.calm = total < g_post.budgetMs * 0.5 ? g_post.calm + 1 : 0;
+    if (g_post.settle > 0) { --g_post.settle; return; }
+    if (total > g_post.budgetMs) {
+        for (int p = POST_COUNT - 1; p >= 0; --p) {
+            PostLevel& L = g_post.level[p];
+            if (!g_post.ran[p]) continue;
+            L = L == PostLevel::Full && POST_HAS_HALF[p] ? PostLevel::Half : PostLevel::Off;
+            if (L == PostLevel::Off) g_post.costMs[p] = 0;
+            g_post.settle = POST_SETTLE;
+            return;
+        }
+    }
+    else if (g_post.calm >= POST_CALM) {
+        for (int p = 0; p < POST_COUNT; ++p) {
+            PostLevel& L = g_post.level[p];
+            if (L == PostLevel::Full) continue;
+            L = L == PostLevel::Off && POST_HAS_HALF[p] ? PostLevel::Half : PostLevel::Full;
+            g_post.settle = POST_SETTLE;
+            g_post.calm = 0;
+            return;
+        }
+    }
+}
+
+static void postProcess() {
+    if (g_post.vigCol.empty()) postBuildVignette();
+    std::fill(g_post.ran, g_post.ran + POST_COUNT, false);
+    const PostLevel* L = g_post.level;
+    float amp = 6.f * g_screenFx.shake * g_screenFx.shake;
+    if (L[POST_SHAKE] != PostLevel::Off && amp >= 1.f) {
+        int ox = int(amp * std::sin(g_screenFx.time * 73.f)), oy = int(amp * std::cos(g_screenFx.time * 91.f));
+        g_post.scratch.resize(size_t(WIDTH) * HEIGHT);
+        uint32_t bg = RGBA(15, 15, 18);
+        postTimed(POST_SHAKE, [&] {
+            postBands([&](int y0, int y1) {
+                std::copy(g_fb.px + size_t(y0) * WIDTH, g_fb.px + size_t(y1) * WIDTH, g_post.scratch.data() + size_t(y0) * WIDTH);
+            });
+            postBands([&](int y0, int y1) { // reads rows other bands copied, so after the first batch
+                int x0 = std::max(0, ox), x1 = std::min(WIDTH, WIDTH + ox);
+                for (int y = y0; y < y1; ++y) {
+                    uint32_t* row = g_fb.px + size_t(y) * WIDTH;
+                    int sy = y - oy;
+                    if (sy < 0 || sy >= HEIGHT) { std::fill(row, row + WIDTH, bg); continue; }
+                    const uint32_t* src = g_post.scratch.data() + size_t(sy) * WIDTH;
+                    std::fill(row, row + x0, bg);
+                    std::copy(src + (x0 - ox), src + (x1 - ox), row + x0);
+                    std::fill(row + x1, row + WIDTH, bg);
+                }
+            });
+        });
+    }
+    if (L[POST_FLASH] != PostLevel::Off && g_screenFx.flash > 0.f) {
+        float s = 0.45f * g_screenFx.flash;
+        postTimed(POST_FLASH, [&] { postBands([&](int y0, int y1) { postFlash(y0, y1, s); }); });
+    }
+    if (L[POST_VIGNETTE] != PostLevel::Off) {
+        bool half = L[POST_VIGNETTE] == PostLevel::Half;
+        postTimed(POST_VIGNETTE, [&] { postBands([&](int y0, int y1) { postVignette(y0, y1, half); }); });
+    }
+    if (g_post.crt && L[POST_SCANLINES] != PostLevel::Off) {
+        bool half = L[POST_SCANLINES] == PostLevel::Half;
+        postTimed(POST_SCANLINES, [&] { postBands([&](int y0, int y1) { postScanlines(y0, y1, half); }); });
+    }
+    postAdjust();
+}
+
+static void postReport() {
+    printf("post (budget %.2f ms):", g_post.budgetMs);
+    for (int p = 0; p < POST_COUNT; ++p) {
+        PostLevel L = g_post.level[p];
+        printf(" %s %s %.3f ms%s", POST_NAMES[p], L == PostLevel::Full ? "full" : L == PostLevel::Half ? "half" : "off",
+            g_post.costMs[p], p + 1 < POST_COUNT ? "," : "\n");
+    }
+}
+
+// Indexed world layer (-pal8): the world passes rasterize palette indices, a quarter of
+// the bytes of 32-bit fills, and the layer is expanded into the framebuffer before
+// lighting, the HUD and post-processing, which need true colour.
+struct IndexedLayer {
+    bool on = false;
+    std::vector<uint8_t> store;
+    Surface surf;
+};
+static IndexedLayer g_indexed;
+
+// Expands indexed src into the 32-bit dst of the same size, in row bands on the job pool.
+static void expandSurface(const Surface& src, Surface& dst) {
+    int bands = std::min(src.h, jobThreads() * 2);
+    parallelFor(bands, [&](int k) {
+        size_t y0 = size_t(src.h) * k / bands, y1 = size_t(src.h) * (k + 1) / bands;
+        expandPal8(src.idx + y0 * src.w, dst.px + y0 * dst.w, (y1 - y0) * src.w, g_palette.lut);
+    });
+}
+
+// Sorts and replays the recorded commands onto the current target, then empties the list.
+static void drawListFlush() {
+    DrawList& D = g_draw;
+    std::vector<DrawCmd>& C = D.cmds;
+    double t0 = nowSeconds();
+    std::sort(C.begin(), C.end(), [](const DrawCmd& a, const DrawCmd& b) { return a.key != b.key ? a.key < b.key : a.seq < b.seq; });
+    double t1 = nowSeconds();
+    std::vector<int>& starts = D.starts;
+    starts.clear();
+    for (size_t i = 0; i < C.size(); ++i) if (i == 0 || C[i].key != C[i - 1].key) starts.push_back(int(i));
+    starts.push_back(int(C.size()));
+    Surface& T = *g_target;
+    auto replay = [&](int y0, int y1) {
+        for (size_t b = 0; b + 1 < starts.size(); ++b) {
+            int i = starts[b], n = starts[b + 1] - i;
+            // drop commands outside the band, keep the rest contiguous for the batch
+            int lo = i, hi = i + n;
+            if (y0 > T.top || y1 < T.h) {
+                static thread_local std::vector<DrawCmd> kept;
+                kept.clear();
+                for (int k = lo; k < hi; ++k) {
+                    int r0, r1;
+                    cmdRows(C[k], r0, r1);
+                    if (r1 > y0 && r0 < y1) kept.push_back(C[k]);
+                }
+                if (!kept.empty()) execBatch(kept.data(), int(kept.size()));
             }
+            else execBatch(&C[lo], n);
         }
+    };
+    if (T.idx || C.empty()) replay(T.top, T.h); // palIndex is single-threaded
+    else {
+        int bands = std::min(T.h - T.top, jobThreads() * 2);
+        parallelFor(bands, [&](int k) {
+            Surface band = T;
+            band.top = T.top + (T.h - T.top) * k / bands;
+            band.h = T.top + (T.h - T.top) * (k + 1) / bands;
+            g_target = &band;
+            replay(band.top, band.h);
+            g_target = &g_fb; // the caller's own target is restored below
+        });
+        g_target = &T;
+    }
+    D.replayMs += (nowSeconds() - t1) * 1e3;
+    D.sortMs += (t1 - t0) * 1e3;
+    D.commands += C.size();
+    D.batches += starts.size() - 1;
+    ++D.frames;
+    C.clear();
+}
 
-        // render
-        clear(RGBA(15, 15, 18));
-        Room& RR = g_dungeon[g_ry][g_rx];
-        drawRoom(RR);
-        drawEnemies(RR);
-        drawBullets();
-        drawPlayer();
-        drawHUD();
+static void drawListReport() {
+    const DrawList& D = g_draw;
+    if (!D.frames) return;
+    printf("draw list: %.1f commands in %.1f batches per frame, sort %.3f ms, replay %.3f ms\n",
+        double(D.commands) / D.frames, double(D.batches) / D.frames, D.sortMs / D.frames, D.replayMs / D.frames);
+}
 
-        BitBlt(hdc, 0, 0, WIDTH, HEIGHT, memDC, 0, 0, SRCCOPY);
-        Sleep(1);
+static void renderFrame() {
+    IndexedLayer& I = g_indexed;
+    if (I.on) {
+        I.store.resize(size_t(g_fb.w) * g_fb.h);
+        I.surf.idx = I.store.data(); I.surf.w = g_fb.w; I.surf.h = g_fb.h;
+        g_target = &I.surf;
     }
+    cmdClear(RGBA(15, 15, 18));
+    Room RR = currentRoom();
+    drawRoom(RR);
+    drawEnemies(RR);
+    drawBullets();
+    drawPlayer();
+    { ProfZone zone(PZ_DRAWLIST, g_draw.cmds.size()); drawListFlush(); }
+    if (I.on) {
+        g_target = &g_fb;
+        expandSurface(I.surf, g_fb);
+    }
+    lightApply(RR);
+    { ProfZone zone(PZ_HUD, 1); drawHUD(); }
+    { ProfZone zone(PZ_POST, size_t(g_fb.h)); postProcess(); }
+    if (g_trace.overlay) drawLatencyOverlay();
+    traceRendered();
+}
 
-    // cleanup
-    DeleteObject(dib);
-    DeleteDC(memDC);
-    ReleaseDC(hwnd, hdc);
-    DestroyWindow(hwnd);
-    return 0;
+// Everything a frame is drawn from, folded into one key: when it matches the key of
+// the last presented frame the image would come out the same, so the loop can skip
+// the render and wait for input instead. Shake reads the fx clock, so it counts while
+// it runs; the adaptive post levels count because they change what postProcess does.
+static uint64_t sceneKey() {
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto mix = [&](uint64_t v) { h = (h ^ v) * 0x100000001b3ull; };
+    auto mixVec = [&](const Vec& v) { mix(scalarBits(v.x)); mix(scalarBits(v.y)); };
+    mix(uint64_t(g_rx)); mix(uint64_t(g_ry)); mix(uint64_t(g_player.hp)); mix(g_runOver);
+    mix(g_floorSerial); mix(g_clearedVersion);
+    mixVec(g_player.p);
+    for (const Bullet& b : g_player.shots) mixVec(b.p);
+    for (const Enemy& e : currentRoom().enemies()) { mixVec(e.p); mix(scalarBits(e.hp)); mix(uint64_t(e.kind)); }
+    auto mixF = [&](float f) { uint32_t u; memcpy(&u, &f, 4); mix(u); };
+    mixF(g_screenFx.flash); mixF(g_screenFx.shake);
+    if (g_screenFx.shake > 0.f) mixF(g_screenFx.time);
+    for (int p = 0; p < POST_COUNT; ++p) mix(uint64_t(g_post.level[p]));
+    mix(g_post.crt); mix(g_indexed.on);
+    mix(g_trace.overlay ? g_trace.total.n + 1 : 0);
+    return h;
+}
+static const int IDLE_WAIT_MS = 100; // longest block on input while the scene is still
+
+// Fixed ring of whole frames between the game thread and one worker. The writer
+// fills a free slot (or counts a drop when the worker is behind); the reader
+// waits briefly for a slot, consumes it and releases it.
+struct FrameRing {
+    uint32_t slots = 0;
+    size_t frameWords = 0;
+    std::vector<uint32_t> pool;
+    std::atomic<uint32_t> head{ 0 }, tail{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+    std::mutex m;
+    std::condition_variable cv;
+
+    void init(uint32_t n, size_t words) {
+        slots = n; frameWords = words;
+        pool.assign(size_t(n) * words, 0);
+        head = 0; tail = 0; dropped = 0;
+    }
+    uint32_t* beginWrite() {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return pool.data() + (t % slots) * frameWords;
+    }
+    uint32_t writeSlot() const { return tail.load(std::memory_order_relaxed) % slots; }
+    void endWrite() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        cv.notify_one();
+    }
+    bool push(const uint32_t* frame) {
+        uint32_t* dst = beginWrite();
+        if (!dst) return false;
+        memcpy(dst, frame, frameWords * 4);
+        endWrite();
+        return true;
+    }
+    const uint32_t* peek(int waitMs) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait_for(lk, std::chrono::milliseconds(waitMs));
+            if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        }
+        return pool.data() + (h % slots) * frameWords;
+    }
+    uint32_t readSlot() const { return head.load(std::memory_order_relaxed) % slots; }
+    void release() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+};
+
+// ---------------------------------------------------------------------------
+// Frame capture: the game thread copies each presented frame into a free slot of
+// a fixed ring and moves on; a worker thread converts and writes the slots out.
+// When the writer falls behind the frame is dropped and counted, never waited on.
+//
+// Y4M: YUV4MPEG2, 4:2:0 full-range BT.601 (C420jpeg), nominal 60 fps.
+// Raw: "ISAACRAW", u32 width, u32 height, then per frame u32 payload bytes followed
+//      by (u32 zeroRun, u32 literalCount, literalCount x u32) tokens describing the
+//      frame XORed with the previous one (the first frame is XORed with zeros).
+// ---------------------------------------------------------------------------
+enum class CaptureFormat { Y4M, RawDelta };
+struct FrameCapture {
+    static const uint32_t SLOTS = 8;
+    CaptureFormat fmt = CaptureFormat::Y4M;
+    int w = 0, h = 0;
+    FILE* f = nullptr;
+    FrameRing ring;
+    std::atomic<bool> run{ false };
+    std::thread th;
+    std::atomic<uint64_t> written{ 0 };
+    // worker-only scratch
+    std::vector<uint8_t> yuv;
+    std::vector<uint32_t> prev, tokens;
+};
+static FrameCapture g_capture;
+
+// Y for 8 pixels: (77R + 150G + 29B + 128) >> 8 in unsigned 16-bit lanes.
+static inline __m128i lumaRow8(__m128i r, __m128i g, __m128i b) {
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(29)));
+    return _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+}
+// Split 8 RGBA() pixels into 16-bit r, g, b lanes.
+static inline void unpackRgb8(const uint32_t* p, __m128i& r, __m128i& g, __m128i& b) {
+    __m128i a = _mm_loadu_si128((const __m128i*)p), c = _mm_loadu_si128((const __m128i*)(p + 4));
+    __m128i m = _mm_set1_epi32(0xFF);
+    r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, FB_SHIFT_R), m), _mm_and_si128(_mm_srli_epi32(c, FB_SHIFT_R), m));
+    g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), m), _mm_and_si128(_mm_srli_epi32(c, 8), m));
+    b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, FB_SHIFT_B), m), _mm_and_si128(_mm_srli_epi32(c, FB_SHIFT_B), m));
+}
+// Chroma for 4 2x2 blocks from 16-bit channel sums of two rows: c = ((kr*R + kg*G + kb*B) >> 8) + 128.
+static inline __m128i chroma4(__m128i rs, __m128i gs, __m128i bs, int kr, int kg, int kb) {
+    const __m128i one = _mm_set1_epi16(1), two = _mm_set1_epi32(2);
+    __m128i r = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rs, one), two), 2);
+    __m128i g = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(gs, one), two), 2);
+    __m128i b = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(bs, one), two), 2);
+    __m128i r16 = _mm_packs_epi32(r, r), g16 = _mm_packs_epi32(g, g), b16 = _mm_packs_epi32(b, b);
+    __m128i rg = _mm_unpacklo_epi16(r16, g16), b1 = _mm_unpacklo_epi16(b16, one);
+    __m128i v = _mm_add_epi32(_mm_madd_epi16(rg, _mm_set_epi16(short(kg), short(kr), short(kg), short(kr), short(kg), short(kr), short(kg), short(kr))),
+        _mm_madd_epi16(b1, _mm_set_epi16(128, short(kb), 128, short(kb), 128, short(kb), 128, short(kb))));
+    v = _mm_add_epi32(_mm_srai_epi32(v, 8), _mm_set1_epi32(128));
+    return v;
+}
+
+static void rgbaToYuv420(const uint32_t* src, int w, int h, uint8_t* Y, uint8_t* U, uint8_t* V) {
+    int cw = w / 2;
+    for (int j = 0; j + 1 < h; j += 2) {
+        const uint32_t* r0 = src + j * w, * r1 = r0 + w;
+        uint8_t* y0 = Y + j * w, * y1 = y0 + w, * u = U + (j / 2) * cw, * v = V + (j / 2) * cw;
+        int i = 0;
+        for (; i + 8 <= w; i += 8) {
+            __m128i ra, ga, ba, rb, gb, bb;
+            unpackRgb8(r0 + i, ra, ga, ba);
+            unpackRgb8(r1 + i, rb, gb, bb);
+            _mm_storel_epi64((__m128i*)(y0 + i), _mm_packus_epi16(lumaRow8(ra, ga, ba), ra));
+            _mm_storel_epi64((__m128i*)(y1 + i), _mm_packus_epi16(lumaRow8(rb, gb, bb), rb));
+            __m128i rs = _mm_add_epi16(ra, rb), gs = _mm_add_epi16(ga, gb), bs = _mm_add_epi16(ba, bb);
+            __m128i cu = chroma4(rs, gs, bs, -43, -85, 128), cv = chroma4(rs, gs, bs, 128, -107, -21);
+            __m128i uv = _mm_packus_epi16(_mm_packs_epi32(cu, cv), _mm_setzero_si128()); // u0..u3 v0..v3
+            uint32_t uw = uint32_t(_mm_cvtsi128_si32(uv)), vw = uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(uv, 4)));
+            memcpy(u + i / 2, &uw, 4); memcpy(v + i / 2, &vw, 4);
+        }
+        for (; i + 1 < w; i += 2) { // scalar tail
+            int rs = 0, gs = 0, bs = 0;
+            for (int k = 0; k < 4; ++k) {
+                uint32_t p = (k < 2 ? r0 : r1)[i + (k & 1)];
+                int r = pxR(p), g = pxG(p), b = pxB(p);
+                (k < 2 ? y0 : y1)[i + (k & 1)] = uint8_t((77 * r + 150 * g + 29 * b + 128) >> 8);
+                rs += r; gs += g; bs += b;
+            }
+            rs = (rs + 2) >> 2; gs = (gs + 2) >> 2; bs = (bs + 2) >> 2;
+            u[i / 2] = uint8_t(clamp(((-43 * rs - 85 * gs + 128 * bs + 128) >> 8) + 128, 0, 255));
+            v[i / 2] = uint8_t(clamp(((128 * rs - 107 * gs - 21 * bs + 128) >> 8) + 128, 0, 255));
+        }
+    }
+}
+
+static void captureWriteSlot(FrameCapture& C, const uint32_t* frame) {
+    size_t n = size_t(C.w) * C.h;
+    if (C.fmt == CaptureFormat::Y4M) {
+        uint8_t* Y = C.yuv.data(), * U = Y + n, * V = U + n / 4;
+        rgbaToYuv420(frame, C.w, C.h, Y, U, V);
+        fwrite("FRAME\n", 1, 6, C.f);
+        fwrite(C.yuv.data(), 1, C.yuv.size(), C.f);
+        return;
+    }
+    // XOR against the previous frame, then run-length encode the zero words
+    C.tokens.clear();
+    size_t i = 0;
+    while (i < n) {
+        size_t z = i;
+        while (z < n && frame[z] == C.prev[z]) ++z;
+        size_t l = z;
+        while (l < n && frame[l] != C.prev[l]) ++l;
+        C.tokens.push_back(uint32_t(z - i));
+        C.tokens.push_back(uint32_t(l - z));
+        for (size_t k = z; k < l; ++k) C.tokens.push_back(frame[k] ^ C.prev[k]);
+        i = l;
+    }
+    uint32_t bytes = uint32_t(C.tokens.size() * 4);
+    fwrite(&bytes, 4, 1, C.f);
+    fwrite(C.tokens.data(), 4, C.tokens.size(), C.f);
+    std::copy(frame, frame + n, C.prev.begin());
+}
+
+static void captureThread(FrameCapture& C) {
+    for (;;) {
+        const uint32_t* frame = C.ring.peek(5);
+        if (!frame) {
+            if (!C.run.load()) break;
+            continue;
+        }
+        captureWriteSlot(C, frame);
+        C.ring.release();
+        C.written.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static bool captureStart(const std::string& path, int w, int h) {
+    FrameCapture& C = g_capture;
+    C.f = fopen(path.c_str(), "wb");
+    if (!C.f) return false;
+    C.w = w; C.h = h;
+    C.fmt = (path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0) ? CaptureFormat::Y4M : CaptureFormat::RawDelta;
+    C.ring.init(FrameCapture::SLOTS, size_t(w) * h);
+    if (C.fmt == CaptureFormat::Y4M) {
+        C.yuv.resize(size_t(w) * h + 2 * size_t(w / 2) * (h / 2));
+        fprintf(C.f, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", w, h);
+    }
+    else {
+        C.prev.assign(size_t(w) * h, 0);
+        uint32_t dims[2] = { uint32_t(w), uint32_t(h) };
+        fwrite("ISAACRAW", 1, 8, C.f);
+        fwrite(dims, 4, 2, C.f);
+    }
+    C.run = true;
+    C.th = std::thread(captureThread, std::ref(C));
+    return true;
+}
+
+// Game-thread side: one memcpy into a free slot, or a dropped-frame count.
+static void captureFrame(const uint32_t* frame) {
+    FrameCapture& C = g_capture;
+    if (!C.run.load(std::memory_order_relaxed)) return;
+    C.ring.push(frame);
+}
+
+static void captureStop() {
+    FrameCapture& C = g_capture;
+    if (!C.run.exchange(false)) return;
+    C.ring.cv.notify_one();
+    C.th.join();
+    fclose(C.f); C.f = nullptr;
+    printf("capture: %llu frames written, %llu dropped\n",
+        (unsigned long long)C.written.load(), (unsigned long long)C.ring.dropped.load());
+}
+
+// ---------------------------------------------------------------------------
+// Screenshots: the game thread copies the frame into one of two pooled buffers; a
+// background thread writes it as QOI and as PNG. The PNG rows are split into one
+// chunk per job thread; each chunk is filtered and deflated on its own (fixed
+// Huffman, greedy LZ77) and ends byte-aligned with an empty stored block, so the
+// chunk streams concatenate into one valid zlib stream.
+// ---------------------------------------------------------------------------
+// Appends the QOI chunks for n pixels, without header or end marker. The stream tiles
+// (TILE_QOI) use the same chunks.
+static void qoiChunks(const uint32_t* px, size_t n, std::vector<uint8_t>& out) {
+    uint32_t seen[64] = {};
+    uint32_t prev = RGBA(0, 0, 0);
+    int run = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t p = px[i] | 0xFF000000u; // the framebuffer alpha is not meaningful
+        if (p == prev) {
+            if (++run == 62) { out.push_back(uint8_t(0xC0 | (run - 1))); run = 0; }
+            continue;
+        }
+        if (run) { out.push_back(uint8_t(0xC0 | (run - 1))); run = 0; }
+        int r = pxR(p), g = pxG(p), b = pxB(p);
+        int idx = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+        if (seen[idx] == p) out.push_back(uint8_t(idx));
+        else {
+            seen[idx] = p;
+            int pr = pxR(prev), pg = pxG(prev), pb = pxB(prev);
+            int8_t dr = int8_t(r - pr), dg = int8_t(g - pg), db = int8_t(b - pb);
+            int8_t drg = int8_t(dr - dg), dbg = int8_t(db - dg);
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                out.push_back(uint8_t(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+            else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                out.push_back(uint8_t(0x80 | (dg + 32)));
+                out.push_back(uint8_t(((drg + 8) << 4) | (dbg + 8)));
+            }
+            else { out.push_back(0xFE); out.push_back(uint8_t(r)); out.push_back(uint8_t(g)); out.push_back(uint8_t(b)); }
+        }
+        prev = p;
+    }
+    if (run) out.push_back(uint8_t(0xC0 | (run - 1)));
+}
+
+static std::vector<uint8_t> encodeQoi(const uint32_t* px, int w, int h) {
+    std::vector<uint8_t> out;
+    out.reserve(size_t(w) * h + 64);
+    auto be32 = [&](uint32_t v) { for (int k = 3; k >= 0; --k) out.push_back(uint8_t(v >> (k * 8))); };
+    out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+    be32(uint32_t(w)); be32(uint32_t(h));
+    out.push_back(3); out.push_back(0); // RGB, sRGB
+    qoiChunks(px, size_t(w) * h, out);
+    out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+    return out;
+}
+
+// Decodes QOI chunks (as written by qoiChunks) into count pixels passed to put(i, pixel).
+// Returns false when the data ends early.
+template<typename Put>
+static bool qoiDecodeChunks(const uint8_t* p, size_t bytes, int count, Put put) {
+    const uint8_t* end = p + bytes;
+    uint32_t seen[64] = {};
+    int r = 0, g = 0, b = 0;
+    for (int i = 0; i < count;) {
+        if (p >= end) return false;
+        uint8_t c = *p++;
+        int run = 1;
+        if (c == 0xFE) {
+            if (end - p < 3) return false;
+            r = p[0]; g = p[1]; b = p[2]; p += 3;
+        }
+        else if ((c & 0xC0) == 0x00) { uint32_t q = seen[c]; r = pxR(q); g = pxG(q); b = pxB(q); }
+        else if ((c & 0xC0) == 0x40) { r = (r + ((c >> 4) & 3) - 2) & 0xFF; g = (g + ((c >> 2) & 3) - 2) & 0xFF; b = (b + (c & 3) - 2) & 0xFF; }
+        else if ((c & 0xC0) == 0x80) {
+            if (p >= end) return false;
+            int dg = (c & 0x3F) - 32, d2 = *p++;
+            r = (r + dg + (d2 >> 4) - 8) & 0xFF; g = (g + dg) & 0xFF; b = (b + dg + (d2 & 15) - 8) & 0xFF;
+        }
+        else run = (c & 0x3F) + 1; // 0xC0 run; 0xFF (RGBA) is never written
+        uint32_t px = RGBA(uint8_t(r), uint8_t(g), uint8_t(b));
+        seen[(r * 3 + g * 5 + b * 7 + 255 * 11) % 64] = px;
+        for (; run > 0 && i < count; --run) put(i++, px);
+    }
+    return true;
+}
+
+struct BitWriter {
+    std::vector<uint8_t>& out;
+    uint64_t acc = 0;
+    int n = 0;
+    explicit BitWriter(std::vector<uint8_t>& o) : out(o) {}
+    void put(uint32_t bits, int count) { // LSB first
+        acc |= uint64_t(bits) << n; n += count;
+        while (n >= 8) { out.push_back(uint8_t(acc)); acc >>= 8; n -= 8; }
+    }
+    void putRev(uint32_t code, int count) { // Huffman codes go MSB first
+        uint32_t r = 0;
+        for (int i = 0; i < count; ++i) r |= ((code >> i) & 1) << (count - 1 - i);
+        put(r, count);
+    }
+    void align() { if (n) put(0, 8 - n); }
+};
+
+static const uint16_t LEN_BASE[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const uint8_t  LEN_EXTRA[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const uint16_t DIST_BASE[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const uint8_t  DIST_EXTRA[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+static void putFixedSym(BitWriter& bw, int sym) {
+    if (sym < 144)      bw.putRev(0x30 + sym, 8);
+    else if (sym < 256) bw.putRev(0x190 + sym - 144, 9);
+    else if (sym < 280) bw.putRev(sym - 256, 7);
+    else                bw.putRev(0xC0 + sym - 280, 8);
+}
+
+// Deflates data as one fixed-Huffman block. Non-final chunks are closed with an
+// empty stored block so the output ends on a byte boundary.
+static void deflateChunk(const uint8_t* data, size_t n, bool last, std::vector<uint8_t>& out) {
+    const int HBITS = 15, WINDOW = 32768;
+    std::vector<int32_t> head(size_t(1) << HBITS, -1);
+    BitWriter bw(out);
+    bw.put(last ? 1 : 0, 1); bw.put(1, 2); // fixed Huffman
+    auto hash3 = [&](size_t i) { return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << HBITS) - 1); };
+    size_t i = 0;
+    while (i < n) {
+        int bestLen = 0, bestDist = 0;
+        if (i + 3 <= n) {
+            int h = hash3(i);
+            int32_t cand = head[h];
+            head[h] = int32_t(i);
+            if (cand >= 0 && i - size_t(cand) <= WINDOW) {
+                size_t maxLen = std::min<size_t>(258, n - i);
+                size_t l = 0;
+                while (l < maxLen && data[cand + l] == data[i + l]) ++l;
+                if (l >= 3) { bestLen = int(l); bestDist = int(i - cand); }
+            }
+        }
+        if (!bestLen) { putFixedSym(bw, data[i]); ++i; continue; }
+        int lc = 28;
+        while (LEN_BASE[lc] > bestLen) --lc;
+        putFixedSym(bw, 257 + lc);
+        bw.put(uint32_t(bestLen - LEN_BASE[lc]), LEN_EXTRA[lc]);
+        int dc = 29;
+        while (DIST_BASE[dc] > bestDist) --dc;
+        bw.putRev(uint32_t(dc), 5);
+        bw.put(uint32_t(bestDist - DIST_BASE[dc]), DIST_EXTRA[dc]);
+        for (size_t k = i + 1; k < i + bestLen && k + 3 <= n; ++k) head[hash3(k)] = int32_t(k);
+        i += bestLen;
+    }
+    putFixedSym(bw, 256);
+    if (!last) { bw.put(0, 1); bw.put(0, 2); bw.align(); bw.put(0x0000, 16); bw.put(0xFFFF, 16); }
+    bw.align();
+}
+
+static uint32_t adler32(const uint8_t* p, size_t n) {
+    uint32_t a = 1, b = 0;
+    while (n) {
+        size_t k = std::min<size_t>(n, 5552);
+        n -= k;
+        while (k--) { a += *p++; b += a; }
+        a %= 65521; b %= 65521;
+    }
+    return (b << 16) | a;
+}
+static uint32_t adler32Combine(uint32_t a1, uint32_t a2, size_t len2) {
+    const uint32_t BASE = 65521;
+    uint32_t rem = uint32_t(len2 % BASE);
+    uint32_t s1 = a1 & 0xFFFF, s2 = uint32_t((uint64_t(rem) * s1) % BASE);
+    s1 += (a2 & 0xFFFF) + BASE - 1;
+    s2 += (a1 >> 16) + (a2 >> 16) + BASE - rem;
+    if (s1 >= BASE) s1 -= BASE;
+    if (s1 >= BASE) s1 -= BASE;
+    if (s2 >= (BASE << 1)) s2 -= (BASE << 1);
+    if (s2 >= BASE) s2 -= BASE;
+    return s1 | (s2 << 16);
+}
+static uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc = 0) {
+    // built once under the magic-static guard; encodePng may run on several threads
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    while (n--) crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// PNG row filter choice: the filter with the smallest sum of |residual|.
+static void filterRow(const uint8_t* cur, const uint8_t* up, int bytes, uint8_t* out) {
+    static thread_local std::vector<uint8_t> cand[5];
+    long best = -1; int bestF = 0;
+    for (int f = 0; f < 5; ++f) {
+        cand[f].resize(bytes);
+        long sum = 0;
+        for (int i = 0; i < bytes; ++i) {
+            int a = i >= 3 ? cur[i - 3] : 0, b = up ? up[i] : 0, c = (up && i >= 3) ? up[i - 3] : 0;
+            int pred = 0;
+            switch (f) {
+            case 1: pred = a; break;
+            case 2: pred = b; break;
+            case 3: pred = (a + b) >> 1; break;
+            case 4: { int pp = a + b - c, pa = std::abs(pp - a), pb = std::abs(pp - b), pc = std::abs(pp - c);
+                pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c); } break;
+            }
+            uint8_t r = uint8_t(cur[i] - pred);
+            cand[f][i] = r;
+            sum += r < 128 ? r : 256 - r;
+        }
+        if (best < 0 || sum < best) { best = sum; bestF = f; }
+    }
+    out[0] = uint8_t(bestF);
+    memcpy(out + 1, cand[bestF].data(), bytes);
+}
+
+static std::vector<uint8_t> encodePng(const uint32_t* px, int w, int h, int chunks) {
+    chunks = clamp(chunks, 1, h);
+    const int rowBytes = w * 3;
+    auto rgbRow = [&](int y, uint8_t* dst) { convertPixels(px + size_t(y) * w, dst, size_t(w), PixelFormat::RGB8); };
+    std::vector<std::vector<uint8_t>> streams(chunks);
+    std::vector<uint32_t> adlers(chunks);
+    std::vector<size_t> rawLen(chunks);
+    parallelFor(chunks, [&](int c) {
+        int y0 = h * c / chunks, y1 = h * (c + 1) / chunks;
+        std::vector<uint8_t> raw(size_t(y1 - y0) * (rowBytes + 1)), cur(rowBytes), up(rowBytes);
+        if (y0 > 0) rgbRow(y0 - 1, up.data());
+        for (int y = y0; y < y1; ++y) {
+            rgbRow(y, cur.data());
+            filterRow(cur.data(), y > 0 ? up.data() : nullptr, rowBytes, raw.data() + size_t(y - y0) * (rowBytes + 1));
+            std::swap(cur, up);
+        }
+        adlers[c] = adler32(raw.data(), raw.size());
+        rawLen[c] = raw.size();
+        deflateChunk(raw.data(), raw.size(), c == chunks - 1, streams[c]);
+    });
+
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    auto chunk = [&](const char* type, const std::vector<uint8_t>& data) {
+        uint32_t n = uint32_t(data.size());
+        for (int k = 3; k >= 0; --k) png.push_back(uint8_t(n >> (k * 8)));
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        uint32_t crc = crc32(png.data() + start, png.size() - start);
+        for (int k = 3; k >= 0; --k) png.push_back(uint8_t(crc >> (k * 8)));
+    };
+    std::vector<uint8_t> ihdr;
+    for (uint32_t v : { uint32_t(w), uint32_t(h) }) for (int k = 3; k >= 0; --k) ihdr.push_back(uint8_t(v >> (k * 8)));
+    ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 }); // 8-bit RGB
+    chunk("IHDR", ihdr);
+    std::vector<uint8_t> z = { 0x78, 0x01 };
+    uint32_t adler = adlers[0];
+    for (int c = 0; c < chunks; ++c) {
+        z.insert(z.end(), streams[c].begin(), streams[c].end());
+        if (c) adler = adler32Combine(adler, adlers[c], rawLen[c]);
+    }
+    for (int k = 3; k >= 0; --k) z.push_back(uint8_t(adler >> (k * 8)));
+    chunk("IDAT", z);
+    chunk("IEND", {});
+    return png;
+}
+
+struct Screenshotter {
+    static const uint32_t SLOTS = 2;
+    int w = 0, h = 0;
+    FrameRing ring;
+    std::array<std::string, SLOTS> names;
+    std::atomic<bool> run{ false };
+    std::thread th;
+    std::atomic<uint32_t> saved{ 0 };
+};
+static Screenshotter g_shots;
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+static void screenshotThread(Screenshotter& S) {
+    for (;;) {
+        const uint32_t* px = S.ring.peek(20);
+        if (!px) {
+            if (!S.run.load()) break;
+            continue;
+        }
+        const std::string& base = S.names[S.ring.readSlot()];
+        bool ok = writeFile(base + ".qoi", encodeQoi(px, S.w, S.h));
+        ok = writeFile(base + ".png", encodePng(px, S.w, S.h, jobThreads())) && ok;
+        if (ok) S.saved.fetch_add(1, std::memory_order_relaxed);
+        S.ring.release();
+    }
+}
+
+static void screenshotStart(int w, int h) {
+    Screenshotter& S = g_shots;
+    S.w = w; S.h = h;
+    S.ring.init(Screenshotter::SLOTS, size_t(w) * h);
+    S.run = true;
+    S.th = std::thread(screenshotThread, std::ref(S));
+}
+static void screenshotStop() {
+    Screenshotter& S = g_shots;
+    if (!S.run.exchange(false)) return;
+    S.ring.cv.notify_one();
+    S.th.join();
+}
+
+// Writes <base>.qoi and <base>.png in the background. Returns false (counted as a
+// drop) when both buffers are still being encoded.
+static bool requestScreenshot(const uint32_t* frame, const std::string& base) {
+    Screenshotter& S = g_shots;
+    if (!S.run.load(std::memory_order_relaxed)) return false;
+    uint32_t* dst = S.ring.beginWrite();
+    if (!dst) return false;
+    memcpy(dst, frame, S.ring.frameWords * 4);
+    S.names[S.ring.writeSlot()] = base;
+    S.ring.endWrite();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Remote framebuffer streaming (-stream <port>, watched with -view <port>).
+// The frame is cut into TILE x TILE tiles. A worker hashes each tile and sends only
+// tiles whose hash changed since the last frame it sent, each coded as RLE runs, a
+// <=16 colour palette with 4-bit indices, QOI chunks (lit and shaded tiles, whose
+// gradients defeat the other two), QOI chunks of the per-channel difference from the
+// tile the viewer already has (light that moved a little), or raw pixels, whichever
+// is smallest.
+// The game thread pays nothing while no viewer is connected.
+//
+// Stream (little-endian): hello "ISTR" u16 w, u16 h, u16 tile; then per frame
+// "FRAM" u32 frame, u32 tileCount, u32 payloadBytes, followed by tileCount tiles
+// of u16 tx, u16 ty, u8 encoding, u32 bytes, data.
+// ---------------------------------------------------------------------------
+static const int TILE = 32;
+enum TileEnc : uint8_t { TILE_RAW, TILE_RLE, TILE_PALETTE, TILE_QOI, TILE_QOI_DELTA };
+
+
+struct TileEncoder {
+    int w = 0, h = 0, tilesX = 0, tilesY = 0;
+    std::vector<uint64_t> hashes;   // per tile, of the last frame sent
+    std::vector<uint32_t> sent;     // the frame as the viewer has it
+    std::vector<uint32_t> px, diff; // one tile, row-major: new pixels, and new - sent per channel
+    std::vector<uint8_t> rle, pal, qoi, qoiDelta, out;
+    void init(int W, int H) {
+        w = W; h = H; tilesX = (W + TILE - 1) / TILE; tilesY = (H + TILE - 1) / TILE;
+        hashes.assign(size_t(tilesX) * tilesY, 0);
+        sent.assign(size_t(W) * H, 0);
+        px.resize(TILE * TILE);
+        diff.resize(TILE * TILE);
+    }
+    void invalidate() { std::fill(hashes.begin(), hashes.end(), 0); }
+};
+
+static uint64_t hashTile(const uint32_t* fb, int stride, int tw, int th) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int j = 0; j < th; ++j) {
+        const uint32_t* row = fb + size_t(j) * stride;
+        int i = 0;
+        for (; i + 2 <= tw; i += 2) {
+            uint64_t v; memcpy(&v, row + i, 8);
+            h = (h ^ v) * 0x100000001b3ull;
+        }
+        for (; i < tw; ++i) h = (h ^ row[i]) * 0x100000001b3ull;
+    }
+    return h | 1; // 0 is reserved for "unknown"
+}
+
+// Appends the smallest encoding of one tile. E.diff is only valid (and TILE_QOI_DELTA
+// only allowed) when the viewer already holds an earlier version of the tile.
+static void encodeTile(TileEncoder& E, int n, bool known, std::vector<uint8_t>& out) {
+    const uint32_t* p = E.px.data();
+    E.rle.clear();
+    for (int i = 0; i < n;) {
+        int r = 1;
+        while (i + r < n && r < 65535 && p[i + r] == p[i]) ++r;
+        putU16(E.rle, uint16_t(r)); putU32(E.rle, p[i]);
+        i += r;
+    }
+    E.pal.clear();
+    uint32_t colors[16]; int nc = 0;
+    bool palOk = true;
+    for (int i = 0; i < n && palOk; ++i) {
+        int k = 0;
+        while (k < nc && colors[k] != p[i]) ++k;
+        if (k == nc) { if (nc == 16) palOk = false; else colors[nc++] = p[i]; }
+    }
+    if (palOk) {
+        E.pal.push_back(uint8_t(nc));
+        for (int k = 0; k < nc; ++k) putU32(E.pal, colors[k]);
+        for (int i = 0; i < n; i += 2) {
+            uint8_t b = 0;
+            for (int s2 = 0; s2 < 2 && i + s2 < n; ++s2) {
+                int k = 0;
+                while (colors[k] != p[i + s2]) ++k;
+                b |= uint8_t(k << (s2 * 4));
+            }
+            E.pal.push_back(b);
+        }
+    }
+    E.qoi.clear();
+    qoiChunks(p, size_t(n), E.qoi);
+    E.qoiDelta.clear();
+    if (known) qoiChunks(E.diff.data(), size_t(n), E.qoiDelta);
+    size_t rawBytes = size_t(n) * 4;
+    uint8_t enc = TILE_RAW;
+    const uint8_t* data = (const uint8_t*)p;
+    size_t bytes = rawBytes;
+    if (E.rle.size() < bytes) { enc = TILE_RLE; data = E.rle.data(); bytes = E.rle.size(); }
+    if (palOk && E.pal.size() < bytes) { enc = TILE_PALETTE; data = E.pal.data(); bytes = E.pal.size(); }
+    if (E.qoi.size() < bytes) { enc = TILE_QOI; data = E.qoi.data(); bytes = E.qoi.size(); }
+    if (known && E.qoiDelta.size() < bytes) { enc = TILE_QOI_DELTA; data = E.qoiDelta.data(); bytes = E.qoiDelta.size(); }
+    out.push_back(enc);
+    putU32(out, uint32_t(bytes));
+    out.insert(out.end(), data, data + bytes);
+}
+
+// Builds a FRAM message in E.out with every tile that changed; returns the tile count.
+static int encodeFrameDelta(TileEncoder& E, const uint32_t* fb, uint32_t frameNo) {
+    E.out.clear();
+    E.out.insert(E.out.end(), { 'F', 'R', 'A', 'M' });
+    putU32(E.out, frameNo); putU32(E.out, 0); putU32(E.out, 0);
+    int count = 0;
+    for (int ty = 0; ty < E.tilesY; ++ty) for (int tx = 0; tx < E.tilesX; ++tx) {
+        int x0 = tx * TILE, y0 = ty * TILE;
+        int tw = std::min(TILE, E.w - x0), th = std::min(TILE, E.h - y0);
+        const uint32_t* src = fb + size_t(y0) * E.w + x0;
+        uint64_t hsh = hashTile(src, E.w, tw, th);
+        uint64_t& old = E.hashes[size_t(ty) * E.tilesX + tx];
+        if (hsh == old) continue;
+        bool known = old != 0;
+        old = hsh;
+        for (int j = 0; j < th; ++j) {
+            uint32_t* have = E.sent.data() + size_t(y0 + j) * E.w + x0;
+            for (int i = 0; i < tw; ++i) {
+                uint32_t a = src[size_t(j) * E.w + i], b = have[i];
+                E.px[j * tw + i] = a;
+                E.diff[j * tw + i] = RGBA(uint8_t(pxR(a) - pxR(b)), uint8_t(pxG(a) - pxG(b)), uint8_t(pxB(a) - pxB(b)));
+                have[i] = a;
+            }
+        }
+        putU16(E.out, uint16_t(tx)); putU16(E.out, uint16_t(ty));
+        encodeTile(E, tw * th, known, E.out);
+        ++count;
+    }
+    uint32_t payload = uint32_t(E.out.size() - 16), cnt = uint32_t(count);
+    memcpy(E.out.data() + 8, &cnt, 4);
+    memcpy(E.out.data() + 12, &payload, 4);
+    return count;
+}
+
+// Applies a FRAM payload (the bytes after its 16-byte header) to a framebuffer.
+static bool decodeFrameDelta(const uint8_t* p, size_t bytes, uint32_t tiles, uint32_t* fb, int w, int h) {
+    const uint8_t* end = p + bytes;
+    for (uint32_t t = 0; t < tiles; ++t) {
+        if (end - p < 9) return false;
+        int x0 = getU16(p) * TILE, y0 = getU16(p + 2) * TILE;
+        uint8_t enc = p[4];
+        uint32_t n = getU32(p + 5);
+        p += 9;
+        if (uint32_t(end - p) < n || x0 >= w || y0 >= h) return false;
+        int tw = std::min(TILE, w - x0), th = std::min(TILE, h - y0), count = tw * th;
+        auto put = [&](int i, uint32_t c) { fb[size_t(y0 + i / tw) * w + x0 + i % tw] = c; };
+        if (enc == TILE_RAW) {
+            if (n < uint32_t(count) * 4) return false;
+            for (int i = 0; i < count; ++i) put(i, getU32(p + i * 4));
+        }
+        else if (enc == TILE_RLE) {
+            int i = 0;
+            for (uint32_t k = 0; k + 6 <= n && i < count; k += 6)
+                for (int r = getU16(p + k); r > 0 && i < count; --r) put(i++, getU32(p + k + 2));
+        }
+        else if (enc == TILE_PALETTE) {
+            int nc = p[0];
+            if (nc < 1 || n < uint32_t(1 + nc * 4 + (count + 1) / 2)) return false;
+            const uint8_t* idx = p + 1 + nc * 4;
+            for (int i = 0; i < count; ++i) {
+                int k = (idx[i / 2] >> ((i & 1) * 4)) & 15;
+                put(i, getU32(p + 1 + std::min(k, nc - 1) * 4));
+            }
+        }
+        else if (enc == TILE_QOI) {
+            if (!qoiDecodeChunks(p, n, count, put)) return false;
+        }
+        else if (enc == TILE_QOI_DELTA) {
+            auto add = [&](int i, uint32_t d) {
+                uint32_t& q = fb[size_t(y0 + i / tw) * w + x0 + i % tw];
+                q = RGBA(uint8_t(pxR(q) + pxR(d)), uint8_t(pxG(q) + pxG(d)), uint8_t(pxB(q) + pxB(d)));
+            };
+            if (!qoiDecodeChunks(p, n, count, add)) return false;
+        }
+        p += n;
+    }
+    return true;
+}
+
+static bool netStart() {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+    signal(SIGPIPE, SIG_IGN); // a viewer going away is a send error, not a kill
+    return true;
+#endif
+}
+static void netStop() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+// Makes a blocking send on s fail once it has waited ms milliseconds.
+static void setSendTimeout(SOCKET s, int ms) {
+#ifdef _WIN32
+    DWORD t = DWORD(ms);
+#else
+    timeval t{ ms / 1000, (ms % 1000) * 1000 };
+#endif
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&t, sizeof(t));
+}
+
+static bool sendAll(SOCKET s, const uint8_t* p, size_t n) {
+    while (n) {
+        int k = send(s, (const char*)p, int(std::min<size_t>(n, 1 << 20)), 0);
+        if (k <= 0) return false;
+        p += k; n -= size_t(k);
+    }
+    return true;
+}
+static bool recvAll(SOCKET s, uint8_t* p, size_t n) {
+    while (n) {
+        int k = recv(s, (char*)p, int(std::min<size_t>(n, 1 << 20)), 0);
+        if (k <= 0) return false;
+        p += k; n -= size_t(k);
+    }
+    return true;
+}
+
+struct FrameStreamer {
+    static const uint32_t SLOTS = 3;
+    int w = 0, h = 0;
+    FrameRing ring;
+    TileEncoder enc;
+    SOCKET listenSock = INVALID_SOCKET, client = INVALID_SOCKET;
+    std::atomic<bool> run{ false }, connected{ false };
+    std::thread th;
+    uint32_t frameNo = 0;
+    uint64_t frames = 0, bytes = 0, tiles = 0; // worker-only stats
+    double encodeSec = 0;
+};
+static FrameStreamer g_stream;
+
+static void streamThread(FrameStreamer& S) {
+    while (S.run.load()) {
+        if (S.client == INVALID_SOCKET) {
+            fd_set rd; FD_ZERO(&rd); FD_SET(S.listenSock, &rd);
+            timeval tv{ 0, 50000 };
+            if (select(int(S.listenSock) + 1, &rd, nullptr, nullptr, &tv) <= 0) continue;
+            S.client = accept(S.listenSock, nullptr, nullptr);
+            if (S.client == INVALID_SOCKET) continue;
+            int one = 1;
+            setsockopt(S.client, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+            std::vector<uint8_t> hello = { 'I', 'S', 'T', 'R' };
+            putU16(hello, uint16_t(S.w)); putU16(hello, uint16_t(S.h)); putU16(hello, uint16_t(TILE));
+            if (!sendAll(S.client, hello.data(), hello.size())) { closesocket(S.client); S.client = INVALID_SOCKET; continue; }
+            S.enc.invalidate(); // the viewer starts from a blank frame
+            S.connected = true;
+            continue;
+        }
+        const uint32_t* frame = S.ring.peek(20);
+        if (!frame) continue;
+        double t0 = nowSeconds();
+        S.tiles += encodeFrameDelta(S.enc, frame, S.frameNo++);
+        S.encodeSec += nowSeconds() - t0;
+        S.ring.release();
+        ++S.frames; S.bytes += S.enc.out.size();
+        if (!sendAll(S.client, S.enc.out.data(), S.enc.out.size())) {
+            S.connected = false;
+            closesocket(S.client); S.client = INVALID_SOCKET;
+        }
+    }
+    if (S.client != INVALID_SOCKET) closesocket(S.client);
+    closesocket(S.listenSock);
+}
+
+static bool streamStart(int port, int w, int h) {
+    FrameStreamer& S = g_stream;
+    if (!netStart()) return false;
+    S.listenSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET; addr.sin_port = htons(u_short(port)); addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int one = 1;
+    setsockopt(S.listenSock, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    if (S.listenSock == INVALID_SOCKET || bind(S.listenSock, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(S.listenSock, 1) != 0) {
+        if (S.listenSock != INVALID_SOCKET) closesocket(S.listenSock);
+        netStop();
+        return false;
+    }
+    S.w = w; S.h = h;
+    S.enc.init(w, h);
+    S.ring.init(FrameStreamer::SLOTS, size_t(w) * h);
+    S.run = true;
+    S.th = std::thread(streamThread, std::ref(S));
+    return true;
+}
+static void streamFrame(const uint32_t* frame) {
+    if (g_stream.connected.load(std::memory_order_relaxed)) g_stream.ring.push(frame);
+}
+static void streamStop() {
+    FrameStreamer& S = g_stream;
+    if (!S.run.exchange(false)) return;
+    S.th.join();
+    netStop();
+    if (S.frames)
+        printf("stream: %llu frames, %.1f KB/frame, %.1f tiles/frame, encode %.3f ms/frame, %llu dropped\n",
+            (unsigned long long)S.frames, S.bytes / 1024.0 / S.frames, double(S.tiles) / S.frames,
+            S.encodeSec * 1e3 / S.frames, (unsigned long long)S.ring.dropped.load());
+}
+
+// ---------------------------------------------------------------------------
+// Metrics endpoint (-metrics <port>): Prometheus text format over HTTP on
+// 127.0.0.1:<port>, any path but only GET. One background thread accepts a scrape
+// at a time, reads the registry with relaxed loads, answers and closes; the game
+// thread never waits on it.
+// ---------------------------------------------------------------------------
+struct MetricsServer {
+    SOCKET listenSock = INVALID_SOCKET;
+    int port = 0;
+    std::atomic<bool> run{ false };
+    std::thread th;
+    std::atomic<uint64_t> scrapes{ 0 };
+};
+static MetricsServer g_metricsServer;
+
+// Gauges, once a frame from the game thread.
+static void metricsSample() {
+    int64_t alive = 0;
+    for (uint8_t n : g_floor.count) alive += n;
+    metricSet(M_ENEMIES, alive);
+    metricSet(M_BULLETS, int64_t(g_player.shots.size()));
+    metricSet(M_HP, g_player.hp);
+    metricSet(M_DEPTH, g_descent.depth);
+}
+
+// The frame count, the summary and its _sum all come from one acquire load of M_FRAMES.
+// _sum is the running total stored with the newest counted frame, so it matches _count
+// unless the game laps the whole ring while this runs.
+static std::string metricsText() {
+    const int R = Metrics::FRAME_RING;
+    std::string o;
+    char line[256];
+    int64_t frames = g_metrics.v[M_FRAMES].load(std::memory_order_acquire);
+    for (int i = 0; i < M_COUNT; ++i) {
+        const MetricInfo& m = METRICS[i];
+#ifndef ISAAC_COUNT_ALLOCS
+        if (i == M_ALLOCS) continue; // never counted in this build
+#endif
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", m.name, m.help, m.name, m.type, m.name,
+            (long long)(i == M_FRAMES ? frames : g_metrics.v[i].load(std::memory_order_relaxed)));
+        o += line;
+    }
+    std::vector<double> ft;
+    for (int64_t i = 0; i < std::min<int64_t>(frames, R); ++i)
+        ft.push_back(g_metrics.frameUs[i].load(std::memory_order_relaxed) * 1e-6);
+    uint64_t sumUs = frames ? g_metrics.frameSumUs[(frames - 1) % R].load(std::memory_order_relaxed) : 0;
+    o += "# HELP isaac_frame_seconds Frame time; quantiles over the last 256 frames.\n# TYPE isaac_frame_seconds summary\n";
+    for (double q : { 0.5, 0.9, 0.99 }) {
+        snprintf(line, sizeof(line), "isaac_frame_seconds{quantile=\"%g\"} %.6f\n", q, percentile(ft, q));
+        o += line;
+    }
+    snprintf(line, sizeof(line), "isaac_frame_seconds_sum %.6f\nisaac_frame_seconds_count %lld\n",
+        sumUs * 1e-6, (long long)frames);
+    o += line;
+    return o;
+}
+
+// Reads the request head and answers it. The whole read gets one 500 ms deadline and
+// the answer a 500 ms send timeout, so a slow client holds the server for about a
+// second at most.
+static void metricsServe(SOCKET c) {
+    const double deadline = nowSeconds() + 0.5;
+    setSendTimeout(c, 500);
+    char req[1024];
+    int got = 0;
+    while (got < int(sizeof(req)) - 1) {
+        double left = deadline - nowSeconds();
+        if (left <= 0) break;
+        fd_set rd; FD_ZERO(&rd); FD_SET(c, &rd);
+        timeval tv{ 0, long(left * 1e6) };
+        if (select(int(c) + 1, &rd, nullptr, nullptr, &tv) <= 0) break;
+        int k = recv(c, req + got, int(sizeof(req)) - 1 - got, 0);
+        if (k <= 0) break;
+        got += k;
+        req[got] = 0;
+        if (strstr(req, "\r\n\r\n")) break;
+    }
+    req[got] = 0;
+    bool get = strncmp(req, "GET ", 4) == 0;
+    std::string body = get ? metricsText() : std::string("only GET\n");
+    char head[160];
+    snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        get ? "200 OK" : "405 Method Not Allowed", body.size());
+    if (sendAll(c, (const uint8_t*)head, strlen(head))) sendAll(c, (const uint8_t*)body.data(), body.size());
+}
+
+static void metricsThread(MetricsServer& S) {
+    while (S.run.load()) {
+        fd_set rd; FD_ZERO(&rd); FD_SET(S.listenSock, &rd);
+        timeval tv{ 0, 50000 };
+        if (select(int(S.listenSock) + 1, &rd, nullptr, nullptr, &tv) <= 0) continue;
+        SOCKET c = accept(S.listenSock, nullptr, nullptr);
+        if (c == INVALID_SOCKET) continue;
+        metricsServe(c);
+        closesocket(c);
+        S.scrapes.fetch_add(1, std::memory_order_relaxed);
+    }
+    closesocket(S.listenSock);
+}
+
+// Port 0 takes any free port; the one bound ends up in g_metricsServer.port.
+static bool metricsStart(int port) {
+    MetricsServer& S = g_metricsServer;
+    if (!netStart()) return false;
+    S.listenSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET; addr.sin_port = htons(u_short(port)); addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int one = 1;
+    setsockopt(S.listenSock, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    socklen_t len = sizeof(addr);
+    if (S.listenSock == INVALID_SOCKET || bind(S.listenSock, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(S.listenSock, 4) != 0 ||
+        getsockname(S.listenSock, (sockaddr*)&addr, &len) != 0) {
+        if (S.listenSock != INVALID_SOCKET) closesocket(S.listenSock);
+        netStop();
+        return false;
+    }
+    S.port = ntohs(addr.sin_port);
+    S.scrapes = 0;
+    S.run = true;
+    S.th = std::thread(metricsThread, std::ref(S));
+    return true;
+}
+static void metricsStop() {
+    MetricsServer& S = g_metricsServer;
+    if (!S.run.exchange(false)) return;
+    S.th.join();
+    netStop();
+    printf("metrics: %llu scrapes on port %d\n", (unsigned long long)S.scrapes.load(), S.port);
+}
+
+// ---------------------------------------------------------------------------
+// Shared-memory frame export (-shm <name>). The backbuffer itself lives in a named
+// segment laid out as a header page followed by SHM_SLOTS page-aligned frames, and
+// the game renders straight into the next slot, so readers see frames with no copy
+// and no IPC round trip. Each slot is guarded by a seqlock: the writer makes seq
+// odd before drawing and even once the frame is presented, then publishes it in
+// `latest`. A reader takes slot latest % SHM_SLOTS, checks seq is even and
+// slot.frame == latest, uses the pixels in place and re-checks seq afterwards.
+// Timestamps are steady_clock nanoseconds, which all processes share.
+// ---------------------------------------------------------------------------
+static const uint32_t SHM_SLOTS = 3;
+static const uint32_t SHM_PAGE = 4096;
+struct ShmSlot {
+    std::atomic<uint32_t> seq;
+    uint32_t pad;
+    std::atomic<uint64_t> frame;       // frame number held by the slot
+    std::atomic<int64_t> presentNs;    // when it was presented
+};
+struct ShmHeader {
+    char magic[8];                     // "ISAACSHM"
+    uint32_t version, width, height, strideBytes, slots;
+    uint32_t frameOffset, frameBytes;  // slot i starts at frameOffset + i * frameBytes
+    uint32_t format;                   // PixelFormat of the frames (version 2)
+    std::atomic<uint64_t> latest;      // last published frame, 0 = none yet
+    ShmSlot slot[SHM_SLOTS];
+};
+static_assert(sizeof(ShmHeader) <= SHM_PAGE, "ShmHeader must fit in the header page");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+
+static int64_t nowNs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct ShmMapping {
+    uint8_t* base = nullptr;
+    size_t bytes = 0;
+#ifdef _WIN32
+    HANDLE handle = nullptr;
+#else
+    int fd = -1;
+    std::string path;
+    bool owner = false;
+#endif
+};
+
+static bool shmMap(ShmMapping& M, const std::string& name, size_t bytes, bool create) {
+#ifdef _WIN32
+    std::string path = "Local\\isaac_" + name;
+    M.handle = create ? CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(uint64_t(bytes) >> 32), DWORD(bytes), path.c_str())
+        : OpenFileMapping(FILE_MAP_READ, FALSE, path.c_str());
+    if (!M.handle) return false;
+    M.base = (uint8_t*)MapViewOfFile(M.handle, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, create ? bytes : 0);
+    if (!M.base) { CloseHandle(M.handle); M.handle = nullptr; return false; }
+    M.bytes = bytes;
+#else
+    M.path = "/isaac_" + name;
+    M.fd = shm_open(M.path.c_str(), create ? O_CREAT | O_RDWR : O_RDONLY, 0600);
+    if (M.fd < 0) return false;
+    struct stat st{};
+    if (create && ftruncate(M.fd, off_t(bytes)) != 0) { close(M.fd); shm_unlink(M.path.c_str()); return false; }
+    if (!create) { fstat(M.fd, &st); bytes = size_t(st.st_size); }
+    void* p = mmap(nullptr, bytes, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, M.fd, 0);
+    if (p == MAP_FAILED) { close(M.fd); if (create) shm_unlink(M.path.c_str()); return false; }
+    M.base = (uint8_t*)p; M.bytes = bytes; M.owner = create;
+#endif
+    return true;
+}
+static void shmUnmap(ShmMapping& M) {
+    if (!M.base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(M.base);
+    CloseHandle(M.handle);
+#else
+    munmap(M.base, M.bytes);
+    close(M.fd);
+    if (M.owner) shm_unlink(M.path.c_str());
+#endif
+    M.base = nullptr;
+}
+
+struct ShmExport {
+    ShmMapping map;
+    ShmHeader* hdr = nullptr;
+    uint64_t frame = 0;                // frame being drawn
+#ifdef _WIN32
+    HBITMAP dibs[SHM_SLOTS] = {};      // windowed: one DIB section per slot
+#endif
+};
+static ShmExport g_shm;
+
+static uint32_t* shmSlotPixels(ShmExport& E, uint32_t slot) {
+    return (uint32_t*)(E.map.base + E.hdr->frameOffset + size_t(slot) * E.hdr->frameBytes);
+}
+
+static bool shmExportStart(ShmExport& E, const std::string& name, int w, int h) {
+    uint32_t frameBytes = (uint32_t(w) * h * 4 + SHM_PAGE - 1) / SHM_PAGE * SHM_PAGE;
+    if (!shmMap(E.map, name, SHM_PAGE + size_t(frameBytes) * SHM_SLOTS, true)) return false;
+    E.hdr = new (E.map.base) ShmHeader();
+    E.hdr->version = 2; E.hdr->format = uint32_t(FB_FORMAT); E.hdr->width = uint32_t(w); E.hdr->height = uint32_t(h);
+    E.hdr->strideBytes = uint32_t(w) * 4; E.hdr->slots = SHM_SLOTS;
+    E.hdr->frameOffset = SHM_PAGE; E.hdr->frameBytes = frameBytes;
+    for (auto& sl : E.hdr->slot) { sl.seq = 0; sl.frame = 0; sl.presentNs = 0; }
+    E.hdr->latest.store(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(E.hdr->magic, "ISAACSHM", 8); // written last: readers wait for it
+    E.frame = 0;
+    return true;
+}
+
+// Marks the next slot as being written and returns its pixels to render into.
+static uint32_t* shmBeginFrame(ShmExport& E) {
+    ShmSlot& sl = E.hdr->slot[++E.frame % SHM_SLOTS];
+    sl.seq.store(sl.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return shmSlotPixels(E, uint32_t(E.frame % SHM_SLOTS));
+}
+// Call right after the frame has been presented.
+static void shmPublish(ShmExport& E) {
+    ShmSlot& sl = E.hdr->slot[E.frame % SHM_SLOTS];
+    sl.frame.store(E.frame, std::memory_order_relaxed);
+    sl.presentNs.store(nowNs(), std::memory_order_relaxed);
+    sl.seq.store(sl.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    E.hdr->latest.store(E.frame, std::memory_order_release);
+}
+static void shmExportStop(ShmExport& E) {
+#ifdef _WIN32
+    for (auto& d : E.dibs) if (d) { DeleteObject(d); d = nullptr; }
+#endif
+    shmUnmap(E.map);
+    E.hdr = nullptr;
+}
+
+// -shm-read: spin on `latest`, validate each new frame with the seqlock and touch
+// its pixels in place. Stops after 2 s without a new frame.
+static int runShmReader(const std::string& name) {
+    ShmMapping M;
+    double start = nowSeconds();
+    while (!shmMap(M, name, 0, false)) {
+        if (nowSeconds() - start > 5) { fprintf(stderr, "shm-read: no segment '%s'\n", name.c_str()); return 1; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const ShmHeader* H = (const ShmHeader*)M.base;
+    while (memcmp(H->magic, "ISAACSHM", 8) != 0) std::this_thread::yield();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    std::vector<double> latUs;
+    uint64_t last = 0, frames = 0, missed = 0, torn = 0, checksum = 0;
+    double idleSince = nowSeconds();
+    while (nowSeconds() - idleSince < 2.0) {
+        uint64_t L = H->latest.load(std::memory_order_acquire);
+        if (L == last) { _mm_pause(); continue; }
+        const ShmSlot& sl = H->slot[L % H->slots];
+        uint32_t s1 = sl.seq.load(std::memory_order_acquire);
+        if ((s1 & 1) || sl.frame.load(std::memory_order_relaxed) != L) { ++torn; continue; }
+        int64_t presented = sl.presentNs.load(std::memory_order_relaxed);
+        double lat = (nowNs() - presented) / 1e3;
+        const uint32_t* px = (const uint32_t*)(M.base + H->frameOffset + size_t(L % H->slots) * H->frameBytes);
+        uint32_t sum = 0;
+        for (uint32_t y = 0; y < H->height; y += 8) sum += px[size_t(y) * H->width + (y % H->width)];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sl.seq.load(std::memory_order_relaxed) != s1) { ++torn; continue; }
+        if (last && L > last + 1) missed += L - last - 1;
+        last = L; ++frames; checksum += sum;
+        latUs.push_back(lat);
+        idleSince = nowSeconds();
+    }
+    printf("shm-read: %llu frames, %llu missed, %llu torn retries; present->visible p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        (unsigned long long)frames, (unsigned long long)missed, (unsigned long long)torn,
+        percentile(latUs, 0.5), percentile(latUs, 0.99), percentile(latUs, 1.0));
+    shmUnmap(M);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Headless backend: no window, the framebuffer lives on the heap and a scripted
+// bot stands in for the keyboard. Each frame advances 1/60 s of game time.
+// ---------------------------------------------------------------------------
+static void botChooseKeys(float dt) {
+    static std::mt19937 rng(1234);
+    static int lastRoom = -1, targetDoor = 0;
+    static Scalar wanderT = 0.f;
+    static Vec wander;
+    std::fill(std::begin(g_botKeys), std::end(g_botKeys), false);
+    if (g_runOver) { g_botKeys['R'] = true; lastRoom = -1; return; }
+
+    Room R = currentRoom();
+    int roomId = R.c;
+    if (roomId != lastRoom) {
+        lastRoom = roomId;
+        std::vector<int> open;
+        for (int i = 0; i < 4; ++i) if (R.door(i)) open.push_back(i);
+        targetDoor = open.empty() ? 0 : open[rng() % open.size()];
+    }
+    Vec goal;
+    if (R.cleared()) {
+        RECT rc = doorRect((Dir)targetDoor);
+        goal = Vec((rc.left + rc.right) * 0.5f, (rc.top + rc.bottom) * 0.5f);
+    }
+    else {
+        wanderT -= dt;
+        if (wanderT <= 0.f) {
+            wanderT = 1.f;
+            wander = Vec(Scalar(int(ROOM_X + 60 + rng() % (ROOM_W - 120))), Scalar(int(ROOM_Y + 60 + rng() % (ROOM_H - 120))));
+        }
+        goal = wander;
+        const Enemy* best = nullptr;
+        Scalar bestD = 30000;
+        for (auto& e : R.enemies()) {
+            Scalar d = len(e.p - g_player.p);
+            if (d < bestD) { bestD = d; best = &e; }
+        }
+        if (best) {
+            Vec d = best->p - g_player.p;
+            if (sabs(d.x) > sabs(d.y)) g_botKeys[d.x < 0 ? VK_LEFT : VK_RIGHT] = true;
+            else g_botKeys[d.y < 0 ? VK_UP : VK_DOWN] = true;
+        }
+    }
+    Vec d = goal - g_player.p;
+    if (d.x < -4) g_botKeys['A'] = true;
+    if (d.x > 4)  g_botKeys['D'] = true;
+    if (d.y < -4) g_botKeys['W'] = true;
+    if (d.y > 4)  g_botKeys['S'] = true;
+}
+// The bot's keys reach the simulation as events, like a keyboard's.
+static void botThink(float dt) {
+    botChooseKeys(dt);
+    double t = nowSeconds();
+    for (int vk = 0; vk < 256; ++vk) inputPush(vk, g_botKeys[vk], t);
+}
+
+static bool g_repaint = false; // the window lost its contents (uncovered, restored)
+
+#ifdef _WIN32
+static LRESULT CALLBACK WndProc(HWND h, UINT m, WPARAM w, LPARAM l) {
+    if (m == WM_DESTROY) { g_running = false; PostQuitMessage(0); return 0; }
+    if (m == WM_KEYDOWN || m == WM_KEYUP || m == WM_SYSKEYDOWN || m == WM_SYSKEYUP) {
+        // GetMessageTime is when the key event was queued, not when it is dispatched
+        double t = nowSeconds() - double(DWORD(GetTickCount() - DWORD(GetMessageTime()))) * 1e-3;
+        inputPush(int(w), m == WM_KEYDOWN || m == WM_SYSKEYDOWN, t);
+    }
+    if (m == WM_KILLFOCUS) inputReleaseAll(nowSeconds());
+    if (m == WM_PAINT) {
+        PAINTSTRUCT ps;
+        BeginPaint(h, &ps);
+        EndPaint(h, &ps);
+        g_repaint = true;
+        return 0;
+    }
+    return DefWindowProc(h, m, w, l);
+}
+
+// Win32 window presenting a 32-bit top-down DIB section. BI_RGB is BGRA8; other
+// framebuffer formats draw into a staging buffer converted at present.
+struct GameWindow {
+    HWND hwnd = nullptr;
+    HDC hdc = nullptr, memDC = nullptr;
+    HBITMAP dib = nullptr;
+    uint32_t* dibBits = nullptr;
+    std::vector<uint32_t> staging;
+    uint32_t* pixels = nullptr;
+    int w = 0, h = 0;
+};
+
+static void closeWindow(GameWindow& W) {
+    DeleteObject(W.dib);
+    DeleteDC(W.memDC);
+    ReleaseDC(W.hwnd, W.hdc);
+    DestroyWindow(W.hwnd);
+    W = GameWindow{};
+}
+// Cleans up after itself when it fails.
+static bool openWindow(GameWindow& W, LPCTSTR title, int w, int h) {
+    HINSTANCE hInst = GetModuleHandle(nullptr);
+    WNDCLASS wc{}; wc.lpszClassName = TEXT("IsaacLikeWin"); wc.hInstance = hInst; wc.lpfnWndProc = WndProc; wc.hCursor = LoadCursor(NULL, IDC_ARROW);
+    RegisterClass(&wc);
+    DWORD style = WS_OVERLAPPEDWINDOW & ~(WS_MAXIMIZEBOX | WS_THICKFRAME);
+    W.hwnd = CreateWindow(wc.lpszClassName, title,
+        style, CW_USEDEFAULT, CW_USEDEFAULT, w + 16, h + 39, nullptr, nullptr, hInst, nullptr);
+    if (!W.hwnd) return false;
+    ShowWindow(W.hwnd, SW_SHOW);
+
+    // Backbuffer
+    g_bmpInfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    g_bmpInfo.bmiHeader.biWidth = w;
+    g_bmpInfo.bmiHeader.biHeight = -h; // top-down
+    g_bmpInfo.bmiHeader.biPlanes = 1;
+    g_bmpInfo.bmiHeader.biBitCount = 32;
+    g_bmpInfo.bmiHeader.biCompression = BI_RGB;
+
+    W.hdc = GetDC(W.hwnd);
+    W.memDC = CreateCompatibleDC(W.hdc);
+    void* bits = nullptr;
+    W.dib = CreateDIBSection(W.hdc, &g_bmpInfo, DIB_RGB_COLORS, &bits, NULL, 0);
+    SelectObject(W.memDC, W.dib);
+    W.dibBits = (uint32_t*)bits; W.w = w; W.h = h;
+    if (FB_FORMAT != PixelFormat::BGRA8) W.staging.assign(size_t(w) * h, 0);
+    W.pixels = W.staging.empty() ? W.dibBits : W.staging.data();
+    if (!W.dibBits) { closeWindow(W); return false; }
+    return true;
+}
+static void presentWindow(GameWindow& W) {
+    if (!W.staging.empty()) convertPixels(W.staging.data(), W.dibBits, W.staging.size(), PixelFormat::BGRA8);
+    BitBlt(W.hdc, 0, 0, W.w, W.h, W.memDC, 0, 0, SRCCOPY);
+}
+// BitBlt has finished with the DIB by the time it returns.
+static void waitForImage(GameWindow&) {}
+// Dispatches pending messages; false once the window has been closed.
+static bool pumpMessages(GameWindow&) {
+    MSG msg{};
+    while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+        if (msg.message == WM_QUIT) g_running = false;
+        TranslateMessage(&msg); DispatchMessage(&msg);
+    }
+    return g_running;
+}
+// Blocks until a message arrives or ms pass.
+static void waitForInput(GameWindow&, int ms) {
+    MsgWaitForMultipleObjects(0, nullptr, FALSE, DWORD(ms), QS_ALLINPUT);
+}
+// Windowed -shm: one DIB section per ring slot, created on the shared mapping.
+static bool shmAttachWindow(ShmExport& E, GameWindow& W) {
+    if (FB_FORMAT != PixelFormat::BGRA8) return false; // GDI would show the slots swizzled
+    for (uint32_t i = 0; i < SHM_SLOTS; ++i) {
+        void* bits = nullptr;
+        E.dibs[i] = CreateDIBSection(W.hdc, &g_bmpInfo, DIB_RGB_COLORS, &bits, E.map.handle, E.hdr->frameOffset + i * E.hdr->frameBytes);
+        if (!E.dibs[i]) return false;
+    }
+    return true;
+}
+// Points the blit source at the slot being drawn, or back at the window's own DIB.
+static void shmWindowSlot(ShmExport& E, GameWindow& W) { SelectObject(W.memDC, E.dibs[E.frame % SHM_SLOTS]); }
+static void shmDetachWindow(ShmExport&, GameWindow& W) { SelectObject(W.memDC, W.dib); }
+#else
+// X11 window presenting a ZPixmap. With MIT-SHM the XImage data is a SysV segment
+// the server reads directly, so the game draws straight into it and present is a
+// single XShmPutImage whose completion event is only waited for before the image is
+// written again; without it XPutImage copies over the socket. When the visual's
+// layout (BGRA8, RGBA8 or 16-bit RGB565) differs from FB_FORMAT the game draws into a
+// staging buffer that is converted into the image at present.
+struct GameWindow {
+    Display* dpy = nullptr;
+    Window win = 0;
+    GC gc = nullptr;
+    XImage* img = nullptr;
+    XShmSegmentInfo shm{};
+    bool useShm = false;  // segment attached; cleared to force the XPutImage path
+    bool hasShm = false;
+    int shmCompletion = 0; // event type of XShmCompletionEvent
+    bool shmBusy = false;  // a put is in flight and the server may still read the image
+    Atom wmDelete = 0;
+    PixelFormat format = FB_FORMAT; // of the image
+    std::vector<uint32_t> staging;
+    uint32_t* pixels = nullptr;
+    int w = 0, h = 0;
+};
+
+static bool g_xShmFailed = false;
+static int xShmErrorHandler(Display*, XErrorEvent*) { g_xShmFailed = true; return 0; }
+
+// XShmAttach fails asynchronously on remote displays, so sync under a
+// temporary error handler before trusting the segment.
+static bool xAttachShm(GameWindow& W, Visual* vis, int depth) {
+    if (!XShmQueryExtension(W.dpy)) return false;
+    W.img = XShmCreateImage(W.dpy, vis, unsigned(depth), ZPixmap, nullptr, &W.shm, unsigned(W.w), unsigned(W.h));
+    if (!W.img) return false;
+    W.shm.shmid = shmget(IPC_PRIVATE, size_t(W.img->bytes_per_line) * W.h, IPC_CREAT | 0600);
+    if (W.shm.shmid >= 0) {
+        W.shm.shmaddr = W.img->data = (char*)shmat(W.shm.shmid, nullptr, 0);
+        if (W.shm.shmaddr != (char*)-1) {
+            W.shm.readOnly = False;
+            g_xShmFailed = false;
+            XErrorHandler old = XSetErrorHandler(xShmErrorHandler);
+            bool ok = XShmAttach(W.dpy, &W.shm);
+            XSync(W.dpy, False);
+            XSetErrorHandler(old);
+            shmctl(W.shm.shmid, IPC_RMID, nullptr); // freed once both sides detach
+            if (ok && !g_xShmFailed) { W.shmCompletion = XShmGetEventBase(W.dpy) + ShmCompletion; return true; }
+            shmdt(W.shm.shmaddr);
+        } else {
+            shmctl(W.shm.shmid, IPC_RMID, nullptr);
+        }
+    }
+    W.img->data = nullptr;
+    XDestroyImage(W.img);
+    W.img = nullptr;
+    return false;
+}
+
+static Bool xIsShmCompletion(Display*, XEvent* ev, XPointer type) { return ev->type == *(int*)type; }
+// Blocks until the server has finished reading the image from the last XShmPutImage.
+// Called before anything writes the image; pumpMessages clears shmBusy when the event
+// has already arrived.
+static void waitForImage(GameWindow& W) {
+    if (!W.shmBusy) return;
+    XEvent ev;
+    XIfEvent(W.dpy, &ev, xIsShmCompletion, (XPointer)&W.shmCompletion);
+    W.shmBusy = false;
+}
+static void closeWindow(GameWindow& W) {
+    if (!W.dpy) return;
+    if (W.img) {
+        if (W.hasShm) {
+            waitForImage(W);
+            XShmDetach(W.dpy, &W.shm);
+            XSync(W.dpy, False);
+            shmdt(W.shm.shmaddr);
+            W.img->data = nullptr;
+        }
+        XDestroyImage(W.img); // frees the calloc'd data in the fallback case
+    }
+    if (W.gc) XFreeGC(W.dpy, W.gc);
+    if (W.win) XDestroyWindow(W.dpy, W.win);
+    XCloseDisplay(W.dpy);
+    W = GameWindow{};
+}
+
+// Cleans up after itself when it fails.
+static bool openWindow(GameWindow& W, LPCTSTR title, int w, int h) {
+    W.dpy = XOpenDisplay(nullptr);
+    if (!W.dpy) return false;
+    int scr = DefaultScreen(W.dpy);
+    Visual* vis = DefaultVisual(W.dpy, scr);
+    int depth = DefaultDepth(W.dpy, scr);
+    if (depth == 16 && vis->red_mask == 0xF800) W.format = PixelFormat::RGB565;
+    else if ((depth == 24 || depth == 32) && vis->red_mask == 0xFF0000) W.format = PixelFormat::BGRA8;
+    else if ((depth == 24 || depth == 32) && vis->red_mask == 0xFF) W.format = PixelFormat::RGBA8;
+    else { closeWindow(W); return false; }
+    int bpp = PIXEL_BYTES[int(W.format)];
+    W.w = w; W.h = h;
+    W.win = XCreateSimpleWindow(W.dpy, RootWindow(W.dpy, scr), 0, 0, unsigned(w), unsigned(h), 0, 0, BlackPixel(W.dpy, scr));
+    XStoreName(W.dpy, W.win, title);
+    XSizeHints hints{};
+    hints.flags = PMinSize | PMaxSize;
+    hints.min_width = hints.max_width = w;
+    hints.min_height = hints.max_height = h;
+    XSetWMNormalHints(W.dpy, W.win, &hints);
+    W.wmDelete = XInternAtom(W.dpy, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(W.dpy, W.win, &W.wmDelete, 1);
+    XSelectInput(W.dpy, W.win, KeyPressMask | KeyReleaseMask | FocusChangeMask | StructureNotifyMask | ExposureMask);
+    W.gc = XCreateGC(W.dpy, W.win, 0, nullptr);
+    XMapWindow(W.dpy, W.win);
+
+    // Backbuffer
+    W.useShm = W.hasShm = xAttachShm(W, vis, depth);
+    if (!W.img) {
+        char* data = (char*)calloc(size_t(w) * h, size_t(bpp));
+        W.img = XCreateImage(W.dpy, vis, unsigned(depth), ZPixmap, 0, data, unsigned(w), unsigned(h), bpp * 8, w * bpp);
+        if (!W.img) free(data);
+    }
+    if (!W.img || W.img->bits_per_pixel != bpp * 8 || W.img->bytes_per_line != w * bpp) { closeWindow(W); return false; }
+    if (W.format != FB_FORMAT) W.staging.assign(size_t(w) * h, 0);
+    W.pixels = W.staging.empty() ? (uint32_t*)W.img->data : W.staging.data();
+    return true;
+}
+static void presentWindow(GameWindow& W) {
+    if (!W.staging.empty()) {
+        waitForImage(W);
+        convertPixels(W.staging.data(), W.img->data, W.staging.size(), W.format);
+    }
+    if (W.useShm) {
+        waitForImage(W); // an Expose repaint may come before the last put has been read
+        XShmPutImage(W.dpy, W.win, W.gc, W.img, 0, 0, 0, 0, unsigned(W.w), unsigned(W.h), True);
+        W.shmBusy = true;
+    }
+    else XPutImage(W.dpy, W.win, W.gc, W.img, 0, 0, 0, 0, unsigned(W.w), unsigned(W.h));
+    XFlush(W.dpy);
+}
+// Keysym to the VK code keyDown() is asked about; 0 for keys the game ignores.
+static int xKeyToVk(KeySym k) {
+    if (k >= XK_a && k <= XK_z) return int('A' + (k - XK_a));
+    if (k >= XK_A && k <= XK_Z) return int('A' + (k - XK_A));
+    switch (k) {
+    case XK_Left: return VK_LEFT;
+    case XK_Right: return VK_RIGHT;
+    case XK_Up: return VK_UP;
+    case XK_Down: return VK_DOWN;
+    case XK_Escape: return VK_ESCAPE;
+    case XK_F3: return VK_F3;
+    case XK_F12: return VK_F12;
+    }
+    return 0;
+}
+// Drains pending events into g_keys; false once the window has been closed.
+static bool pumpMessages(GameWindow& W) {
+    while (XPending(W.dpy)) {
+        XEvent ev;
+        XNextEvent(W.dpy, &ev);
+        switch (ev.type) {
+        case KeyPress:
+        case KeyRelease: {
+            // Auto-repeat arrives as a release immediately followed by a press
+            // with the same timestamp; swallow the pair so keys stay held.
+            if (ev.type == KeyRelease && XEventsQueued(W.dpy, QueuedAfterReading)) {
+                XEvent nx;
+                XPeekEvent(W.dpy, &nx);
+                if (nx.type == KeyPress && nx.xkey.time == ev.xkey.time && nx.xkey.keycode == ev.xkey.keycode) {
+                    XNextEvent(W.dpy, &nx);
+                    break;
+                }
+            }
+            // ev.xkey.time is on the server's clock, so the event is stamped on arrival
+            if (int vk = xKeyToVk(XLookupKeysym(&ev.xkey, 0))) {
+                g_keys[vk] = ev.type == KeyPress;
+                inputPush(vk, ev.type == KeyPress, nowSeconds());
+            }
+            break;
+        }
+        case FocusOut: memset(g_keys, 0, sizeof(g_keys)); inputReleaseAll(nowSeconds()); break;
+        case Expose: g_repaint = true; break;
+        case ClientMessage: if (Atom(ev.xclient.data.l[0]) == W.wmDelete) g_running = false; break;
+        case DestroyNotify: g_running = false; break;
+        default: if (ev.type == W.shmCompletion) W.shmBusy = false; break;
+        }
+    }
+    return g_running;
+}
+// Blocks until the X connection has an event to read or ms pass.
+static void waitForInput(GameWindow& W, int ms) {
+    if (XPending(W.dpy)) return;
+    int fd = ConnectionNumber(W.dpy);
+    fd_set rd; FD_ZERO(&rd); FD_SET(fd, &rd);
+    timeval tv{ ms / 1000, (ms % 1000) * 1000 };
+    select(fd + 1, &rd, nullptr, nullptr, &tv);
+}
+// Windowed -shm needs the window to blit from the exported slots; not done on X11.
+static bool shmAttachWindow(ShmExport&, GameWindow&) { return false; }
+static void shmWindowSlot(ShmExport&, GameWindow&) {}
+static void shmDetachWindow(ShmExport&, GameWindow&) {}
+#endif
+
+// -view: decode a -stream session into a window. A receive thread applies tile
+// deltas to a staging frame; the window thread copies it out when it changes.
+static int runViewer(int port) {
+    if (!netStart()) return 1;
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET; addr.sin_port = htons(u_short(port)); addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    uint8_t hello[10];
+    if (s == INVALID_SOCKET || connect(s, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        !recvAll(s, hello, sizeof(hello)) || memcmp(hello, "ISTR", 4) != 0 || getU16(hello + 8) != TILE) {
+        fprintf(stderr, "view: no stream on port %d\n", port);
+        if (s != INVALID_SOCKET) closesocket(s);
+        netStop();
+        return 1;
+    }
+    int w = getU16(hello + 4), h = getU16(hello + 6);
+    GameWindow win;
+    if (!openWindow(win, TEXT("Mini Isaac-like (Viewer)"), w, h)) { closesocket(s); netStop(); return 1; }
+
+    std::vector<uint32_t> staging(size_t(w) * h, 0);
+    std::mutex m;
+    std::atomic<uint32_t> received{ 0 };
+    std::thread rx([&] {
+        std::vector<uint8_t> payload;
+        uint8_t hdr[16];
+        while (recvAll(s, hdr, sizeof(hdr)) && memcmp(hdr, "FRAM", 4) == 0) {
+            payload.resize(getU32(hdr + 12));
+            if (!recvAll(s, payload.data(), payload.size())) break;
+            std::lock_guard<std::mutex> lk(m);
+            if (!decodeFrameDelta(payload.data(), payload.size(), getU32(hdr + 8), staging.data(), w, h)) break;
+            received.fetch_add(1);
+        }
+    });
+    uint32_t shown = 0;
+    while (pumpMessages(win)) {
+        if (keyDown(VK_ESCAPE)) break;
+        uint32_t r = received.load();
+        if (r != shown) {
+            std::lock_guard<std::mutex> lk(m);
+            waitForImage(win);
+            std::copy(staging.begin(), staging.end(), win.pixels);
+            shown = r;
+            presentWindow(win);
+        }
+        Sleep(1);
+    }
+    shutdown(s, SD_BOTH);
+    closesocket(s);
+    rx.join();
+    closeWindow(win);
+    netStop();
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Command line and benchmarks
+// ---------------------------------------------------------------------------
+struct Options {
+    AudioSink audio = AudioSink::Device;
+    std::string wavPath;
+    std::string capturePath;
+    std::string endlessLog; // -endless: descend instead of ending; floor summaries go here
+    bool bench = false;
+    int headlessFrames = 0; // > 0 selects the headless backend
+    int shotFrame = -1;     // headless: screenshot after this frame
+    int streamPort = 0;     // -stream: serve tile deltas on this port
+    int viewPort = 0;       // -view: watch a stream on this port
+    int metricsPort = 0;    // -metrics: serve Prometheus metrics on this port
+    std::string shmName;    // -shm: export frames through shared memory
+    std::string shmRead;    // -shm-read: run the reference reader
+    bool seeded = false;
+    uint64_t seed = 1;
+    int hashTicks = 0;      // -hash-ticks: print the state hash after this many ticks
+    int tickHz = 120;       // -tick-hz: simulation rate
+    std::string atlasPath;  // -atlas: memory-map the sprite atlas from this file
+    bool crt = false;       // -crt: scanline post pass
+    bool pal8 = false;      // -pal8: indexed world layer
+    bool overlay = false;   // -overlay: latency overlay from the start (F3 toggles it)
+    bool profile = false;   // -profile: headless zone times and hardware counters
+    bool idle = true;       // -no-idle: render every frame even when nothing changed
+    double postBudgetMs = 1.5; // -post-budget
+    std::string expectHash;
+};
+static Options parseOptions(const char* cmdLine) {
+    std::vector<std::string> args;
+    std::string cur;
+    for (const char* c = cmdLine ? cmdLine : ""; ; ++c) {
+        if (*c == 0 || *c == ' ' || *c == '\t') {
+            if (!cur.empty()) args.push_back(cur);
+            cur.clear();
+            if (*c == 0) break;
+        }
+        else cur += *c;
+    }
+    Options o;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (a == "-wav" && i + 1 < args.size()) { o.audio = AudioSink::Wav; o.wavPath = args[++i]; }
+        else if (a == "-nosound") o.audio = AudioSink::Null;
+        else if (a == "-bench") o.bench = true;
+        else if (a == "-headless" && i + 1 < args.size()) o.headlessFrames = std::max(1, atoi(args[++i].c_str()));
+        else if (a == "-capture" && i + 1 < args.size()) o.capturePath = args[++i];
+        else if (a == "-endless" && i + 1 < args.size()) o.endlessLog = args[++i];
+        else if (a == "-shot" && i + 1 < args.size()) o.shotFrame = atoi(args[++i].c_str());
+        else if (a == "-stream" && i + 1 < args.size()) o.streamPort = atoi(args[++i].c_str());
+        else if (a == "-view" && i + 1 < args.size()) o.viewPort = atoi(args[++i].c_str());
+        else if (a == "-metrics" && i + 1 < args.size()) o.metricsPort = atoi(args[++i].c_str());
+        else if (a == "-shm" && i + 1 < args.size()) o.shmName = args[++i];
+        else if (a == "-shm-read" && i + 1 < args.size()) o.shmRead = args[++i];
+        else if (a == "-seed" && i + 1 < args.size()) { o.seeded = true; o.seed = strtoull(args[++i].c_str(), nullptr, 10); }
+        else if (a == "-hash-ticks" && i + 1 < args.size()) o.hashTicks = std::max(1, atoi(args[++i].c_str()));
+        else if (a == "-expect" && i + 1 < args.size()) o.expectHash = args[++i];
+        else if (a == "-crt") o.crt = true;
+        else if (a == "-pal8") o.pal8 = true;
+        else if (a == "-overlay") o.overlay = true;
+        else if (a == "-profile") o.profile = true;
+        else if (a == "-no-idle") o.idle = false;
+        else if (a == "-post-budget" && i + 1 < args.size()) o.postBudgetMs = std::max(0.0, atof(args[++i].c_str()));
+        else if (a == "-atlas" && i + 1 < args.size()) o.atlasPath = args[++i];
+        else if (a == "-tick-hz" && i + 1 < args.size()) o.tickHz = clamp(atoi(args[++i].c_str()), 10, 1000);
+    }
+    return o;
+}
+
+// Mix cost of one block with every voice busy, half int16 and half float sources.
+static void benchMixer() {
+    const int BLOCKS = 400;
+    auto M = std::make_unique<Mixer>();
+    M->bank.resize(2);
+    for (int i = 0; i < BLOCKS * AUDIO_BLOCK; ++i) {
+        float v = std::sin(i * 0.05f) * 0.5f;
+        M->bank[0].s16.push_back(int16_t(v * 32767.f));
+        M->bank[1].f32.push_back(v);
+    }
+    for (int i = 0; i < MAX_VOICES; ++i) {
+        AudioCmd c; c.sound = uint16_t(i & 1); c.gain = 1.f / MAX_VOICES; c.pan = (i % 7) / 3.f - 1.f;
+        M->cmds.push(c);
+        if ((i & 255) == 255) mixerDrain(*M);
+    }
+    mixerDrain(*M);
+    std::vector<int16_t> out(AUDIO_BLOCK * 2);
+    double t0 = nowSeconds();
+    for (int b = 0; b < BLOCKS; ++b) mixerRender(*M, out.data(), AUDIO_BLOCK);
+    double us = (nowSeconds() - t0) * 1e6 / BLOCKS;
+    double budgetUs = 1e6 * AUDIO_BLOCK / AUDIO_RATE;
+    printf("mixer: %d voices, %d-frame block: %.1f us/block (%.2f%% of the %.0f us real-time budget)\n",
+        MAX_VOICES, AUDIO_BLOCK, us, 100.0 * us / budgetUs, budgetUs);
+}
+
+// Heap framebuffer with a few seconds of bot play on it, for benchmarks that need a
+// representative frame.
+static std::vector<uint32_t> g_benchFb;
+static void benchScene(int frames = 240) {
+    g_benchFb.assign(size_t(WIDTH) * HEIGHT, 0);
+    g_fb.px = g_benchFb.data(); g_fb.w = WIDTH; g_fb.h = HEIGHT;
+    g_headless = true;
+    resetRun();
+    for (int f = 0; f < frames; ++f) {
+        botThink(1.f / 60.f);
+        if (g_runOver) resetRun();
+        simulateTick(1.f / 120.f); simulateTick(1.f / 120.f);
+    }
+    renderFrame();
+}
+
+static void benchScreenshot() {
+    benchScene();
+    const int REPS = 5;
+    size_t qoiBytes = 0, pngBytes = 0, png1Bytes = 0;
+    double t0 = nowSeconds();
+    for (int i = 0; i < REPS; ++i) qoiBytes = encodeQoi(g_fb.px, WIDTH, HEIGHT).size();
+    double t1 = nowSeconds();
+    for (int i = 0; i < REPS; ++i) png1Bytes = encodePng(g_fb.px, WIDTH, HEIGHT, 1).size();
+    double t2 = nowSeconds();
+    for (int i = 0; i < REPS; ++i) pngBytes = encodePng(g_fb.px, WIDTH, HEIGHT, jobThreads()).size();
+    double t3 = nowSeconds();
+    size_t raw = size_t(WIDTH) * HEIGHT * 3;
+    printf("screenshot %dx%d: qoi %.2f ms %zu bytes (%.1f%%)\n", WIDTH, HEIGHT, (t1 - t0) * 1e3 / REPS, qoiBytes, 100.0 * qoiBytes / raw);
+    printf("screenshot %dx%d: png 1 chunk %.2f ms %zu bytes, %d chunks %.2f ms %zu bytes\n", WIDTH, HEIGHT,
+        (t2 - t1) * 1e3 / REPS, png1Bytes, jobThreads(), (t3 - t2) * 1e3 / REPS, pngBytes);
+}
+
+// Tile-delta stream cost over consecutive gameplay frames. A viewer-side copy decodes
+// every frame and must match the frame (alpha aside, which QOI tiles do not carry).
+static bool benchStream() {
+    g_rng.eng.seed(7); // the same gameplay every run, so figures compare across builds
+    benchScene();
+    TileEncoder E;
+    E.init(WIDTH, HEIGHT);
+    std::vector<uint32_t> view(size_t(WIDTH) * HEIGHT);
+    bool same = true;
+    auto decode = [&] {
+        same &= decodeFrameDelta(E.out.data() + 16, E.out.size() - 16, getU32(E.out.data() + 8), view.data(), WIDTH, HEIGHT);
+        for (size_t i = 0; i < view.size() && same; ++i) same = ((view[i] ^ g_fb.px[i]) & 0x00FFFFFFu) == 0;
+    };
+    encodeFrameDelta(E, g_fb.px, 0);
+    decode();
+    size_t keyBytes = E.out.size();
+    const int FRAMES = 300;
+    size_t bytes = 0, tiles = 0;
+    double enc = 0;
+    for (int f = 1; f <= FRAMES; ++f) {
+        botThink(1.f / 60.f);
+        if (g_runOver) resetRun();
+        simulateTick(1.f / 120.f); simulateTick(1.f / 120.f);
+        renderFrame();
+        double t0 = nowSeconds();
+        tiles += encodeFrameDelta(E, g_fb.px, uint32_t(f));
+        enc += nowSeconds() - t0;
+        bytes += E.out.size();
+        decode();
+    }
+    int total = E.tilesX * E.tilesY;
+    printf("stream %dx%d: first frame %zu bytes; deltas %.0f bytes/frame (%.1f KB/s at 60 fps), %.1f/%d tiles, encode %.3f ms/frame%s\n",
+        WIDTH, HEIGHT, keyBytes, double(bytes) / FRAMES, bytes * 60.0 / FRAMES / 1024.0,
+        double(tiles) / FRAMES, total, enc * 1e3 / FRAMES, same ? "" : " MISMATCH");
+    return same;
+}
+
+// FNV-1a over the simulation state, so runs from different builds can be compared.
+static uint64_t hashGameState() {
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto mix = [&](uint64_t v) { h = (h ^ v) * 0x100000001b3ull; };
+    auto mixVec = [&](const Vec& v) { mix(scalarBits(v.x)); mix(scalarBits(v.y)); };
+    mix(uint64_t(g_rx)); mix(uint64_t(g_ry)); mix(uint64_t(g_player.hp)); mix(g_runOver);
+    mixVec(g_player.p); mix(scalarBits(g_player.shotCooldown));
+    for (const Bullet& b : g_player.shots) { mixVec(b.p); mixVec(b.v); mix(scalarBits(b.ttl)); }
+    for (int y = 0; y < GRID_H; ++y) for (int x = 0; x < GRID_W; ++x) {
+        Room R{ &g_floor, g_floor.cell(x, y) };
+        mix(uint64_t(R.exists()) | uint64_t(R.cleared()) << 1 | uint64_t(R.boss()) << 2 | uint64_t(g_floor.doorMask(R.c)) << 3);
+        for (const Enemy& e : R.enemies()) { mixVec(e.p); mix(scalarBits(e.hp)); mix(uint64_t(e.kind)); }
+    }
+    return h;
+}
+
+// Seeded, bot-driven run of n ticks at tickHz (the bot thinks at 60 fps, so every other
+// tick at the default 120 Hz).
+static void runSeededTicks(uint64_t seed, int ticks, int tickHz = 120) {
+    g_headless = true;
+    g_rng.eng.seed(seed);
+    resetRun();
+    int64_t lastFrame = -1;
+    for (int t = 0; t < ticks; ++t) {
+        int64_t frame = int64_t(t) * 60 / tickHz;
+        if (frame != lastFrame) {
+            botThink(lastFrame < 0 ? 1.f / 60.f : float(frame - lastFrame) / 60.f);
+            if (g_runOver && keyDown('R')) resetRun();
+            lastFrame = frame;
+        }
+        simulateTick(1.f / float(tickHz));
+    }
+}
+
+// -hash-ticks: builds with and without ISAAC_FIXED_MATH (or from different compilers)
+// can be checked for identical state: run one, pass its hash to the other via -expect.
+static int runHashTicks(const Options& opt) {
+    runSeededTicks(opt.seed, opt.hashTicks, opt.tickHz);
+    uint64_t h = hashGameState();
+    printf("state hash (%s, seed %llu, %d ticks at %d Hz): %016llx\n", SCALAR_NAME,
+        (unsigned long long)opt.seed, opt.hashTicks, opt.tickHz, (unsigned long long)h);
+    if (!opt.expectHash.empty() && strtoull(opt.expectHash.c_str(), nullptr, 16) != h) {
+        printf("state hash mismatch: expected %s\n", opt.expectHash.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// Simulation throughput for this build's Scalar; compare a float and a fixed build.
+static void benchSim() {
+    const int TICKS = 200000;
+    double t0 = nowSeconds();
+    runSeededTicks(1, TICKS);
+    double secs = nowSeconds() - t0;
+    printf("sim (%s): %.0f bot-driven ticks/s (%.2f us/tick)\n", SCALAR_NAME, TICKS / secs, secs * 1e6 / TICKS);
+}
+
+// Batch normalize/length against the scalar float helpers: accuracy over random vectors of
+// many magnitudes, on a count that ends in a 4-lane group and a scalar (fails the run past
+// 1e-5 relative error), then throughput on long arrays and on a boss room's 6 enemies.
+static bool benchVecMath() {
+    const int N = 4096, REPS = 2000, ROOM = 6;
+    std::vector<float> x(N), y(N), bx(N), by(N), bl(N), ll(N);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> u(-1.f, 1.f);
+    for (int i = 0; i < N; ++i) {
+        float m = std::pow(10.f, u(rng) * 4.f); // 1e-4 .. 1e4
+        x[i] = u(rng) * m; y[i] = u(rng) * m;
+    }
+    x[0] = y[0] = 0.f; // zero vector stays zero
+    bx = x; by = y;
+    const int n = N - 3; // 511 groups of 8, one of 4, one scalar
+    batchNormalize(bx.data(), by.data(), bl.data(), n);
+    batchLength(x.data(), y.data(), ll.data(), n);
+    double normErr = 0, lenErr = 0;
+    for (int i = 0; i < n; ++i) {
+        float L = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+        float nx = L > 0 ? x[i] / L : 0.f, ny = L > 0 ? y[i] / L : 0.f;
+        normErr = std::max({ normErr, double(std::fabs(bx[i] - nx)), double(std::fabs(by[i] - ny)),
+            L > 0 ? double(std::fabs(bl[i] - L) / L) : double(std::fabs(bl[i])) });
+        lenErr = std::max(lenErr, L > 0 ? double(std::fabs(ll[i] - L) / L) : double(std::fabs(ll[i])));
+    }
+    bool ok = normErr < 1e-5 && lenErr < 1e-5;
+
+    volatile float sink = 0;
+    auto time = [](const std::function<void()>& f, int reps) {
+        double t0 = nowSeconds();
+        for (int r = 0; r < reps; ++r) f();
+        return nowSeconds() - t0;
+    };
+    // the float norm()/len() helpers, spelled out for fixed builds
+    auto scalarNorm = [&](int count) {
+        for (int i = 0; i < count; ++i) {
+            float L = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+            bx[i] = L > 0 ? x[i] / L : 0.f; by[i] = L > 0 ? y[i] / L : 0.f; bl[i] = L;
+        }
+        sink = sink + bx[count - 1];
+    };
+    auto scalarLen = [&](int count) {
+        for (int i = 0; i < count; ++i) ll[i] = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+        sink = sink + ll[count - 1];
+    };
+    auto batchNorm = [&](int count) {
+        std::copy(x.begin(), x.begin() + count, bx.begin()); std::copy(y.begin(), y.begin() + count, by.begin());
+        batchNormalize(bx.data(), by.data(), bl.data(), count);
+        sink = sink + bx[count - 1];
+    };
+    auto batchLen = [&](int count) {
+        batchLength(x.data(), y.data(), ll.data(), count);
+        sink = sink + ll[count - 1];
+    };
+    double m = double(N) * REPS / 1e6;
+    double sn = time([&] { scalarNorm(N); }, REPS), bn = time([&] { batchNorm(N); }, REPS);
+    double sl = time([&] { scalarLen(N); }, REPS), bl2 = time([&] { batchLen(N); }, REPS);
+    const int ROOM_REPS = REPS * N / ROOM;
+    double rs = time([&] { scalarNorm(ROOM); }, ROOM_REPS), rb = time([&] { batchNorm(ROOM); }, ROOM_REPS);
+    printf("vec math (%s): max error normalize %.2e, length %.2e (%s)\n", VEC8_NAME, normErr, lenErr, ok ? "ok" : "FAIL");
+    printf("vec math: scalar norm+len %.0f Mvec/s, batch normalize %.0f Mvec/s; scalar len %.0f Mvec/s, batch length %.0f Mvec/s\n",
+        m / sn, m / bn, m / sl, m / bl2);
+    printf("vec math: %d enemies, scalar %.1f ns, batch normalize %.1f ns\n", ROOM, rs * 1e9 / ROOM_REPS, rb * 1e9 / ROOM_REPS);
+    return ok;
+}
+
+// Bot-driven simulation cost per second of game time at 120, 60 and 30 Hz, then shots
+// fired at a resting enemy from staggered distances at rising speeds: hits found by the
+// swept test vs. by testing only each tick's end position.
+static void benchTickRate() {
+    const int GAME_SECONDS = 600;
+    for (int hz : { 120, 60, 30 }) {
+        double t0 = nowSeconds();
+        runSeededTicks(1, GAME_SECONDS * hz, hz);
+        double secs = nowSeconds() - t0;
+        printf("tick rate %3d Hz: %.2f ms of CPU per game second (%.0fx real time)\n",
+            hz, secs * 1e3 / GAME_SECONDS, GAME_SECONDS / secs);
+    }
+    const int SHOTS = 64;
+    Floor F;
+    F.reset(1, 1);
+    F.exists.set(0);
+    Enemy target;
+    target.p = target.prev = Vec(ROOM_X + ROOM_W / 2, ROOM_Y + ROOM_H / 2);
+    target.hp = 1e4f;
+    F.pool.push_back(target); F.count[0] = 1;
+    Room R{ &F, 0 };
+    for (int hz : { 120, 60, 30 }) {
+        for (int speed : { 360, 1440, 2880 }) {
+            Scalar dt = 1.f / float(hz), rr = 5.f + target.r;
+            int sampled = 0;
+            g_player.shots.clear();
+            for (int i = 0; i < SHOTS; ++i) {
+                Bullet b;
+                b.p = Vec(target.p.x - 200 - (i * 37) % 97, target.p.y + (rr - 1) * Scalar((2 * i - (SHOTS - 1)) / float(SHOTS - 1)));
+                b.v = Vec(Scalar(speed), 0);
+                b.r = 5.f;
+                g_player.shots.push_back(b);
+                Vec q = b.p;
+                for (Scalar t = 0; t < b.ttl; t += dt) { // end-of-tick positions only
+                    q += b.v * dt;
+                    Vec o = q - target.p;
+                    if (dot(o, o) <= rr * rr) { ++sampled; break; }
+                }
+            }
+            Scalar hp0 = R.enemies()[0].hp;
+            while (!g_player.shots.empty()) updateBullets(R, dt);
+            int hits = int(hp0 - R.enemies()[0].hp);
+            printf("tick rate %3d Hz, %4d px/s shots: swept %d/%d hits, end-position test %d/%d\n",
+                hz, speed, hits, SHOTS, sampled, SHOTS);
+        }
+    }
+}
+
+// Aliased midpoint discs against coverage discs of the same sizes, plus how close the
+// coverage of one disc sums to its true area.
+static void benchCircles() {
+    const int CIRCLES = 2000, REPS = 20;
+    std::vector<uint32_t> fb(size_t(WIDTH) * HEIGHT, 0);
+    Surface s; s.px = fb.data(); s.w = WIDTH; s.h = HEIGHT;
+    g_target = &s;
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> ux(0.f, float(WIDTH)), uy(0.f, float(HEIGHT)), ur(4.f, 40.f);
+    struct Disc { float x, y, r; };
+    std::vector<Disc> discs(CIRCLES);
+    for (Disc& d : discs) d = { ux(rng), uy(rng), ur(rng) };
+    double t0 = nowSeconds();
+    for (int k = 0; k < REPS; ++k) for (const Disc& d : discs) fillCircle(int(d.x), int(d.y), int(d.r), RGBA(240, 180, 60));
+    double t1 = nowSeconds();
+    for (int k = 0; k < REPS; ++k) for (const Disc& d : discs) fillCircleAA(d.x, d.y, d.r, RGBA(240, 180, 60));
+    double t2 = nowSeconds();
+    std::fill(fb.begin(), fb.end(), 0u);
+    const float R = 10.3f;
+    fillCircleAA(100.37f, 100.81f, R, RGBA(255, 255, 255));
+    double area = 0;
+    for (uint32_t c : fb) area += (c & 255) / 255.0;
+    g_target = &g_fb;
+    double exact = 3.14159265358979 * R * R;
+    printf("circles: %d discs r 4..40, aliased %.2f ms, anti-aliased %.2f ms (%.2fx); r=%.1f coverage area error %.3f%%\n",
+        CIRCLES, (t1 - t0) * 1e3 / REPS, (t2 - t1) * 1e3 / REPS, (t2 - t1) / (t1 - t0), R, 100.0 * (area - exact) / exact);
+}
+
+// The same sprites blitted by the RLE blitter and pixel by pixel with putpx (what drawing
+// art cost before), checked to produce identical frames.
+static bool benchSprites() {
+    const int SPRITES = 4000, REPS = 20;
+    std::vector<uint32_t> fb(size_t(WIDTH) * HEIGHT), ref;
+    Surface s; s.px = fb.data(); s.w = WIDTH; s.h = HEIGHT;
+    struct Placed { int id, x, y; };
+    std::vector<Placed> list(SPRITES);
+    std::mt19937 rng(3);
+    size_t opaque = 0;
+    for (Placed& p : list) { // some hang off every edge
+        p.id = int(rng() % SPR_COUNT);
+        p.x = int(rng() % (WIDTH + 64)) - 32;
+        p.y = int(rng() % (HEIGHT + 64)) - 32;
+    }
+    // decoded copy of every sprite for the per-pixel path
+    std::vector<std::vector<uint32_t>> decoded(SPR_COUNT);
+    for (int id = 0; id < SPR_COUNT; ++id) {
+        int w = spriteW(g_atlas, id), h = spriteH(g_atlas, id);
+        decoded[id].assign(size_t(w) * h, LAYER_CLEAR);
+        Surface d; d.px = decoded[id].data(); d.w = w; d.h = h;
+        g_target = &d;
+        blitSprite(g_atlas, id, 0, 0);
+    }
+    g_target = &s;
+    auto putpxAll = [&] {
+        for (const Placed& p : list) {
+            int w = spriteW(g_atlas, p.id), h = spriteH(g_atlas, p.id);
+            const uint32_t* src = decoded[p.id].data();
+            for (int j = 0; j < h; ++j) for (int i = 0; i < w; ++i)
+                if (src[j * w + i] != LAYER_CLEAR) putpx(p.x + i, p.y + j, src[j * w + i]);
+        }
+    };
+    auto blitAll = [&] { for (const Placed& p : list) blitSprite(g_atlas, p.id, p.x, p.y); };
+    putpxAll();
+    ref = fb;
+    std::fill(fb.begin(), fb.end(), 0u);
+    blitAll();
+    bool ok = fb == ref;
+    double t0 = nowSeconds();
+    for (int r = 0; r < REPS; ++r) putpxAll();
+    double t1 = nowSeconds();
+    for (int r = 0; r < REPS; ++r) blitAll();
+    double t2 = nowSeconds();
+    g_target = &g_fb;
+    for (const Placed& p : list) for (uint32_t c : decoded[p.id]) opaque += c != LAYER_CLEAR;
+    printf("sprites: %d per frame (%.1f Mpx opaque), atlas %zu bytes; putpx %.2f ms/frame, rle blit %.2f ms/frame (%.1fx), output %s\n",
+        SPRITES, opaque / 1e6, g_atlas.bytes, (t1 - t0) * 1e3 / REPS, (t2 - t1) * 1e3 / REPS,
+        (t1 - t0) / (t2 - t1), ok ? "identical" : "MISMATCH");
+    return ok;
+}
+
+// Lightmap accumulate + composite with one player-sized light and growing numbers of
+// shot-sized lights (median of 50 runs each, so a busy machine does not skew it), and
+// an identity check: ambient 1 must leave the frame as is.
+static bool benchLighting() {
+    benchScene();
+    std::vector<uint32_t> before = g_benchFb;
+    Lightmap saved = g_light;
+    g_light.ambient = 1.f;
+    g_light.lights.clear();
+    lightRun();
+    bool ok = g_benchFb == before;
+    g_light.ambient = saved.ambient;
+    std::mt19937 rng(9);
+    const int REPS = 50;
+    printf("lighting %dx%d lightmap, %d threads, identity %s, median:", LIGHT_W, LIGHT_H, jobThreads(), ok ? "ok" : "FAIL");
+    for (int n : { 1, 100, 300, 1000 }) {
+        std::vector<Light> lights{ { WIDTH / 2.f, HEIGHT / 2.f, 170.f, 1.0f, 0.85f, 0.65f } };
+        for (int i = 1; i < n; ++i) lights.push_back({ float(rng() % WIDTH), float(rng() % HEIGHT), 48.f, 0.5f, 0.55f, 0.7f });
+        std::vector<double> accum, comp;
+        for (int r = 0; r < REPS; ++r) {
+            g_light.lights = lights;
+            int bands = std::min(LIGHT_H, jobThreads() * 2);
+            double t0 = nowSeconds();
+            parallelFor(bands, [&](int k) { lightAccumulate(LIGHT_H * k / bands, LIGHT_H * (k + 1) / bands); });
+            double t1 = nowSeconds();
+            parallelFor(bands, [&](int k) { lightComposite(HEIGHT * k / bands, HEIGHT * (k + 1) / bands); });
+            accum.push_back((t1 - t0) * 1e3); comp.push_back((nowSeconds() - t1) * 1e3);
+        }
+        printf(" %d lights %.3f+%.3f ms%s", n, percentile(accum, 0.5), percentile(comp, 0.5), n == 1000 ? "\n" : ",");
+    }
+    g_light = saved;
+    return ok;
+}
+
+// Conversion throughput from the framebuffer to every target layout at 1080p; each
+// kernel is first checked byte-for-byte on an unaligned, odd-length run.
+static bool benchPixelFormats() {
+    const int W = 1920, H = 1080, REPS = 20;
+    const size_t n = size_t(W) * H, m = 1001;
+    std::vector<uint32_t> src(n);
+    uint32_t x = 12345;
+    for (auto& p : src) { x = x * 1664525u + 1013904223u; p = x; }
+    std::vector<uint8_t> dst(n * 4 + 16);
+    bool ok = true;
+    auto report = [&](PixelFormat from, PixelFormat to, double secs, bool good) {
+        printf("pixels %s -> %-6s %dx%d: %.3f ms/frame, %.2f Gpx/s%s\n", PIXEL_NAMES[int(from)], PIXEL_NAMES[int(to)],
+            W, H, secs * 1e3 / REPS, double(n) * REPS / secs * 1e-9, good ? "" : " MISMATCH");
+        ok = ok && good;
+    };
+    for (PixelFormat f : { PixelFormat::BGRA8, PixelFormat::RGBA8, PixelFormat::RGB565, PixelFormat::RGB8 }) {
+        int bpp = PIXEL_BYTES[int(f)];
+        convertPixels(src.data() + 1, dst.data() + 1, m, f);
+        bool good = true;
+        for (size_t i = 0; i < m; ++i) {
+            uint32_t p = src[i + 1];
+            uint8_t want[4] = { uint8_t(pxB(p)), uint8_t(pxG(p)), uint8_t(pxR(p)), uint8_t(p >> 24) };
+            if (f == PixelFormat::RGBA8 || f == PixelFormat::RGB8) std::swap(want[0], want[2]);
+            if (f == PixelFormat::RGB565) {
+                int v = (pxR(p) >> 3) << 11 | (pxG(p) >> 2) << 5 | pxB(p) >> 3;
+                want[0] = uint8_t(v); want[1] = uint8_t(v >> 8);
+            }
+            good = good && memcmp(dst.data() + 1 + i * bpp, want, size_t(bpp)) == 0;
+        }
+        double t0 = nowSeconds();
+        for (int r = 0; r < REPS; ++r) convertPixels(src.data(), dst.data(), n, f);
+        report(FB_FORMAT, f, nowSeconds() - t0, good);
+    }
+    uint32_t lut[256];
+    for (int i = 0; i < 256; ++i) lut[i] = src[i * 7];
+    std::vector<uint8_t> idx(n);
+    for (size_t i = 0; i < n; ++i) idx[i] = uint8_t(src[i] >> 13);
+    std::vector<uint32_t> out(n);
+    expandPal8(idx.data() + 1, out.data(), m, lut);
+    bool good = true;
+    for (size_t i = 0; i < m; ++i) good = good && out[i] == lut[idx[i + 1]];
+    double t0 = nowSeconds();
+    for (int r = 0; r < REPS; ++r) expandPal8(idx.data(), out.data(), n, lut);
+    report(PixelFormat::PAL8, FB_FORMAT, nowSeconds() - t0, good);
+    return ok;
+}
+
+// Frame cost of an overdraw-heavy flat scene (clear, a room fill with border, discs and
+// small rects) at 1080p and 4K: drawn 32-bit, against drawn indexed plus the expansion.
+// The expanded frame must match the 32-bit one exactly.
+static bool benchIndexed() {
+    const int FRAMES = 20;
+    bool ok = true;
+    for (int H : { 1080, 2160 }) {
+        int W = H * 16 / 9;
+        std::vector<uint32_t> fb(size_t(W) * H), out(fb.size());
+        std::vector<uint8_t> idx(fb.size());
+        auto scene = [&](int f) {
+            clear(RGBA(15, 15, 18));
+            fillRect(W / 16, H / 9, W * 7 / 8, H * 7 / 9, RGBA(20, 20, 25));
+            drawRect(W / 16, H / 9, W * 7 / 8, H * 7 / 9, RGBA(200, 200, 200));
+            for (int i = 0; i < 40; ++i)
+                fillCircle(W / 8 + (i * 97 + f * 5) % (W * 3 / 4), H / 6 + (i * 61) % (H * 2 / 3), H / 40, i & 1 ? RGBA(240, 180, 60) : RGBA(120, 200, 255));
+            for (int i = 0; i < 200; ++i)
+                fillRect((i * 131 + f * 9) % W, (i * 71) % H, H / 100, H / 100, RGBA(255, 255, 255));
+        };
+        Surface s32; s32.px = fb.data(); s32.w = W; s32.h = H;
+        Surface s8; s8.idx = idx.data(); s8.w = W; s8.h = H;
+        Surface so; so.px = out.data(); so.w = W; so.h = H;
+        double t32 = 0, t8 = 0, tx = 0;
+        for (int f = 0; f < FRAMES; ++f) {
+            double t0 = nowSeconds();
+            g_target = &s32; scene(f);
+            double t1 = nowSeconds();
+            g_target = &s8; scene(f);
+            double t2 = nowSeconds();
+            expandSurface(s8, so);
+            double t3 = nowSeconds();
+            t32 += t1 - t0; t8 += t2 - t1; tx += t3 - t2;
+        }
+        g_target = &g_fb;
+        bool same = fb == out;
+        ok = ok && same;
+        printf("indexed %dx%d, %d palette colours: 32-bit %.2f ms/frame, 8-bit %.2f + expand %.2f = %.2f ms/frame%s\n",
+            W, H, g_palette.count, t32 * 1e3 / FRAMES, t8 * 1e3 / FRAMES, tx * 1e3 / FRAMES, (t8 + tx) * 1e3 / FRAMES, same ? "" : " MISMATCH");
+    }
+    return ok;
+}
+
+// A busy world frame (room, 60 discs in three colours, 600 shots) rasterized as recorded
+// against recorded, sorted and replayed in bands; both must give the same pixels.
+// Then the sort alone on larger random lists.
+static bool benchDrawList() {
+    const int FRAMES = 100;
+    std::vector<uint32_t> a(size_t(WIDTH) * HEIGHT), b(a.size());
+    Surface sa; sa.px = a.data(); sa.w = WIDTH; sa.h = HEIGHT;
+    Surface sb = sa; sb.px = b.data();
+    auto scene = [](int f) {
+        cmdClear(RGBA(15, 15, 18));
+        cmdRect(DL_FLOOR, ROOM_X, ROOM_Y, ROOM_W, ROOM_H, RGBA(20, 20, 25));
+        cmdOutline(DL_WALLS, ROOM_X, ROOM_Y, ROOM_W, ROOM_H, RGBA(200, 200, 200));
+        static const uint32_t cols[3] = { RGBA(240, 180, 60), RGBA(120, 200, 255), RGBA(255, 120, 120) };
+        for (int i = 0; i < 60; ++i) // a grid, so reordering colours cannot change overlaps
+            cmdDisc(DL_ENEMIES, ROOM_X + 40 + (i % 12) * 56 + f * 0.25f, ROOM_Y + 50 + (i / 12) * 70 + 0.3f, 14.f, cols[(i * 7) % 3]);
+        for (int i = 0; i < 600; ++i)
+            cmdSprite(DL_SHOTS, SPR_BULLET, ROOM_X + (i * 37 + f * 3) % ROOM_W, ROOM_Y + (i * 53) % ROOM_H);
+        cmdDisc(DL_PLAYER, WIDTH / 2.f, HEIGHT / 2.f, 14.f, RGBA(180, 220, 255));
+    };
+    DrawList saved = g_draw;
+    g_draw = DrawList{};
+    double tImm = 0, tBuf = 0;
+    bool same = true;
+    for (int f = 0; f < FRAMES; ++f) {
+        double t0 = nowSeconds();
+        g_target = &sa; g_draw.immediate = true; scene(f);
+        double t1 = nowSeconds();
+        g_target = &sb; g_draw.immediate = false; scene(f); drawListFlush();
+        double t2 = nowSeconds();
+        tImm += t1 - t0; tBuf += t2 - t1;
+        same = same && a == b;
+    }
+    g_target = &g_fb;
+    printf("draw list %d threads, %.0f commands/frame in %.0f batches: immediate %.3f ms, recorded %.3f ms (sort %.3f, replay %.3f)%s\n",
+        jobThreads(), double(g_draw.commands) / FRAMES, double(g_draw.batches) / FRAMES, tImm * 1e3 / FRAMES, tBuf * 1e3 / FRAMES,
+        g_draw.sortMs / FRAMES, g_draw.replayMs / FRAMES, same ? "" : " MISMATCH");
+    for (int n : { 10000, 100000 }) {
+        std::vector<DrawCmd> cmds(n);
+        uint32_t x = 99;
+        for (int i = 0; i < n; ++i) {
+            x = x * 1664525u + 1013904223u;
+            cmds[i] = DrawCmd{ uint64_t(x % 8) << 60 | uint64_t(x >> 29) << 56 | uint64_t(x % 5) << 32 | ((x >> 8) % 24), 0, 0, 0, 0, uint32_t(i), 0 };
+        }
+        double t0 = nowSeconds();
+        std::sort(cmds.begin(), cmds.end(), [](const DrawCmd& p, const DrawCmd& q) { return p.key != q.key ? p.key < q.key : p.seq < q.seq; });
+        double ms = (nowSeconds() - t0) * 1e3;
+        printf("draw list sort %6d commands: %.3f ms (%.1f ns/command)\n", n, ms, ms * 1e6 / n);
+    }
+    g_draw = saved;
+    return same;
+}
+
+// Span primitives against per-pixel references (the old putpx outline, textbook
+// Bresenham, centre-sampled even-odd test), on shapes that cross every edge of the
+// target, then the cost per call.
+static bool benchPrimitives() {
+    const int N = 2000, REPS = 20;
+    std::vector<uint32_t> a(size_t(WIDTH) * HEIGHT), b(a.size());
+    Surface sa; sa.px = a.data(); sa.w = WIDTH; sa.h = HEIGHT;
+    Surface sb = sa; sb.px = b.data();
+    uint32_t seed = 7;
+    auto rnd = [&](int lo, int hi) { seed = seed * 1664525u + 1013904223u; return lo + int((seed >> 8) % uint32_t(hi - lo)); };
+    auto refRect = [](int x, int y, int w, int h, uint32_t c) {
+        for (int i = x; i < x + w; ++i) { putpx(i, y, c); putpx(i, y + h - 1, c); }
+        for (int j = y; j < y + h; ++j) { putpx(x, j, c); putpx(x + w - 1, j, c); }
+    };
+    auto refLine = [](int x0, int y0, int x1, int y1, uint32_t c) {
+        int dx = std::abs(x1 - x0), dy = std::abs(y1 - y0), sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1, err = dx - dy;
+        for (;;) {
+            putpx(x0, y0, c);
+            if (x0 == x1 && y0 == y1) return;
+            int e2 = 2 * err;
+            if (e2 > -dy) { err -= dy; x0 += sx; }
+            if (e2 < dx) { err += dx; y0 += sy; }
+        }
+    };
+    auto refPoly = [](const float* xy, int n, uint32_t c) {
+        for (int y = 0; y < HEIGHT; ++y) for (int x = 0; x < WIDTH; ++x) {
+            float px = x + 0.5f, yc = y + 0.5f;
+            bool in = false;
+            for (int i = 0, j = n - 1; i < n; j = i++) {
+                float xa = xy[j * 2], ya = xy[j * 2 + 1], xb = xy[i * 2], yb = xy[i * 2 + 1];
+                if ((ya <= yc) != (yb <= yc) && px < edgeX(xa, ya, xb, yb, yc)) in = !in;
+            }
+            if (in) putpx(x, y, c);
+        }
+    };
+    bool ok = true;
+    auto check = [&](const char* name, const std::function<void(bool)>& draw) {
+        std::fill(a.begin(), a.end(), 0); std::fill(b.begin(), b.end(), 0);
+        g_target = &sa; draw(true);
+        g_target = &sb; draw(false);
+        g_target = &g_fb;
+        size_t diff = 0;
+        for (size_t i = 0; i < a.size(); ++i) diff += a[i] != b[i];
+        if (diff) printf("primitives: %s differs from the reference in %zu pixels\n", name, diff);
+        ok = ok && diff == 0;
+    };
+    check("outline", [&](bool ref) {
+        seed = 1;
+        for (int i = 0; i < 300; ++i) {
+            int x = rnd(-60, WIDTH + 20), y = rnd(-60, HEIGHT + 20), w = rnd(1, 120), h = rnd(1, 90);
+            (ref ? refRect : drawRect)(x, y, w, h, RGBA(uint8_t(i), 200, 100));
+        }
+    });
+    check("line", [&](bool ref) {
+        seed = 2;
+        for (int i = 0; i < 600; ++i) { // half crossing the edges, half inside
+            int m = i & 1 ? 0 : 200;
+            int x0 = rnd(-m, WIDTH + m), y0 = rnd(-m, HEIGHT + m), x1 = rnd(-m, WIDTH + m), y1 = rnd(-m, HEIGHT + m);
+            (ref ? refLine : drawLine)(x0, y0, x1, y1, RGBA(uint8_t(i), 100, 200));
+        }
+    });
+    check("polygon", [&](bool ref) {
+        seed = 3;
+        for (int i = 0; i < 12; ++i) {
+            float xy[14];
+            for (int k = 0; k < 14; k += 2) { xy[k] = rnd(-100, WIDTH + 100) + 0.37f; xy[k + 1] = rnd(-100, HEIGHT + 100) + 0.61f; }
+            if (ref) refPoly(xy, 7, RGBA(uint8_t(i * 20), 50, 250));
+            else fillPolygon(xy, 7, RGBA(uint8_t(i * 20), 50, 250));
+        }
+    });
+    auto time = [&](const char* name, const std::function<void(int)>& draw) {
+        g_target = &sb;
+        double t0 = nowSeconds();
+        for (int r = 0; r < REPS; ++r) for (int i = 0; i < N; ++i) draw(i);
+        double ns = (nowSeconds() - t0) * 1e9 / (double(N) * REPS);
+        g_target = &g_fb;
+        printf("primitives %-22s %7.1f ns/call\n", name, ns);
+    };
+    time("outline 120x80", [](int i) { drawRect(i % 800, i % 400, 120, 80, RGBA(200, 200, 200)); });
+    time("outline 120x80 (putpx)", [&](int i) { refRect(i % 800, i % 400, 120, 80, RGBA(200, 200, 200)); });
+    time("hud line 720x1", [](int i) { drawRect(120, i % 500, 720, 1, RGBA(255, 255, 255)); });
+    time("line 300 px", [](int i) { drawLine(i % 600, 20, i % 600 + 300, 20 + i % 200, RGBA(255, 255, 255)); });
+    time("line 300 px (putpx)", [&](int i) { refLine(i % 600, 20, i % 600 + 300, 20 + i % 200, RGBA(255, 255, 255)); });
+    time("thick line 300 px x 6", [](int i) { drawThickLine(i % 600 + 0.5f, 20.f, i % 600 + 300.5f, 20.f + i % 200, 6.f, RGBA(255, 255, 255)); });
+    time("hexagon r 40", [](int i) {
+        float xy[12];
+        for (int k = 0; k < 6; ++k) { xy[k * 2] = 100 + i % 700 + 40 * std::cos(k * 1.0472f); xy[k * 2 + 1] = 100 + i % 300 + 40 * std::sin(k * 1.0472f); }
+        fillPolygon(xy, 6, RGBA(100, 220, 120));
+    });
+    return ok;
+}
+
+// The old room layout (flags, door bools and an enemy vector per room, in a grid of
+// structs) against Floor on a 1000x1000 grid: bytes per room, and the door-neighbour,
+// reachability and any-uncleared queries on each.
+static bool benchFloor() {
+    struct OldRoom {
+        bool exists = false, cleared = false, boss = false;
+        bool doors[4] = { false, false, false, false };
+        std::vector<Enemy> enemies;
+    };
+    const int W = 1000, H = 1000, N = W * H, REPS = 5;
+    std::vector<OldRoom> old(N);
+    Floor F;
+    F.reset(W, H);
+    std::mt19937 rng(70);
+    int last = 0;
+    for (int c = 0; c < N; ++c) {
+        F.first[c] = uint32_t(F.pool.size());
+        if (rng() % 10 >= 7) continue;
+        old[c].exists = true; F.exists.set(c);
+        old[c].cleared = true; F.cleared.set(c);
+        last = c;
+        int n = int(rng() % 4);
+        for (int i = 0; i < n; ++i) { old[c].enemies.push_back(Enemy{}); F.pool.push_back(Enemy{}); }
+        F.count[c] = uint8_t(n);
+    }
+    // one uncleared room at the far end, so the scans cover the whole floor
+    old[last].cleared = false; F.cleared.w[size_t(last) >> 6] &= ~(1ull << (last & 63));
+    for (int y = 0; y < H; ++y) for (int x = 0; x < W; ++x) {
+        int c = y * W + x;
+        if (!old[c].exists) continue;
+        if (x + 1 < W && old[c + 1].exists && rng() % 8) {
+            old[c].doors[int(Dir::Right)] = old[c + 1].doors[int(Dir::Left)] = true;
+            F.addDoor(c, Dir::Right); F.addDoor(c + 1, Dir::Left);
+        }
+        if (y + 1 < H && old[c + W].exists && rng() % 8) {
+            old[c].doors[int(Dir::Down)] = old[c + W].doors[int(Dir::Up)] = true;
+            F.addDoor(c, Dir::Down); F.addDoor(c + W, Dir::Up);
+        }
+    }
+    int start = N / 2 + W / 2; // a room with a door, from the middle on
+    while (!F.doorMask(start)) ++start;
+
+    size_t enemyBytes = 0;
+    for (const OldRoom& R : old) enemyBytes += R.enemies.capacity() * sizeof(Enemy);
+    double oldBytes = double(sizeof(OldRoom)), newBytes = double(F.doors.size() + F.exists.w.size() * 8 * 3 +
+        F.first.size() * sizeof(uint32_t) + F.count.size()) / N;
+
+    static const uint8_t BITS4[16] = { 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
+    auto time = [&](const std::function<long long()>& q, long long& out) {
+        double t0 = nowSeconds();
+        for (int r = 0; r < REPS; ++r) out = q();
+        return (nowSeconds() - t0) * 1e3 / REPS;
+    };
+    long long oldNb = 0, newNb = 0, oldReach = 0, newReach = 0, oldAny = 0, newAny = 0;
+    double oldNbMs = time([&] {
+        long long n = 0;
+        for (int y = 0; y < H; ++y) for (int x = 0; x < W; ++x) {
+            const OldRoom& R = old[y * W + x];
+            n += (R.doors[0] && y > 0 && old[(y - 1) * W + x].exists) + (R.doors[1] && x + 1 < W && old[y * W + x + 1].exists) +
+                (R.doors[2] && y + 1 < H && old[(y + 1) * W + x].exists) + (R.doors[3] && x > 0 && old[y * W + x - 1].exists);
+        }
+        return n;
+    }, oldNb);
+    double newNbMs = time([&] {
+        long long n = 0;
+        for (uint8_t b : F.doors) n += BITS4[b & 15] + BITS4[b >> 4];
+        return n;
+    }, newNb);
+    std::vector<int> queue;
+    double oldReachMs = time([&] {
+        std::vector<bool> seen(N);
+        queue.clear(); queue.push_back(start); seen[start] = true;
+        for (size_t i = 0; i < queue.size(); ++i) {
+            int c = queue[i];
+            for (int d = 0; d < 4; ++d) {
+                if (!old[c].doors[d]) continue;
+                int n = d == 0 ? c - W : d == 1 ? c + 1 : d == 2 ? c + W : c - 1;
+                if (seen[n]) continue;
+                seen[n] = true; queue.push_back(n);
+            }
+        }
+        return (long long)queue.size();
+    }, oldReach);
+    Bits seen;
+    double newReachMs = time([&] { return (long long)F.reach(start, seen, queue); }, newReach);
+    double oldAnyMs = time([&] {
+        for (const OldRoom& R : old) if (R.exists && !R.cleared) return 1ll;
+        return 0ll;
+    }, oldAny);
+    double newAnyMs = time([&] { return (long long)F.anyUncleared(); }, newAny);
+
+    printf("floor %dx%d: %.1f -> %.2f bytes per room (+%.1f of enemies in both)\n", W, H, oldBytes, newBytes, double(enemyBytes) / N);
+    printf("floor %dx%d: door neighbours %.2f -> %.2f ms, reach %.2f -> %.2f ms (%lld rooms), any uncleared %.3f -> %.3f ms\n",
+        W, H, oldNbMs, newNbMs, oldReachMs, newReachMs, newReach, oldAnyMs, newAnyMs);
+    bool ok = oldNb == newNb && oldReach == newReach && oldAny == newAny && newAny == 1;
+    if (!ok) printf("floor: query MISMATCH (neighbours %lld/%lld, reach %lld/%lld, any %lld/%lld)\n",
+        oldNb, newNb, oldReach, newReach, oldAny, newAny);
+    return ok;
+}
+
+// 10,000 floors of endless descent with half a second of bot play on each, then a
+// forced clear once the worker has the next floor ready (a real floor takes far
+// longer to play than to carve): descent latency, and resident floor memory, which
+// must not grow. Then descents back to back, where every one waits for the carve.
+static bool benchDescent() {
+    const int FLOORS = 10000, TICKS = 60, RUSHED = 1000;
+    FILE* log = tmpfile();
+    if (!log) { printf("descent: no temporary file, skipped\n"); return true; }
+    g_headless = true;
+    g_rng.eng.seed(71);
+    descentStart(log);
+    resetRun();
+    size_t bytesAt1k = 0;
+    while (g_descent.depth < FLOORS) {
+        g_player.hp = 1 << 30;
+        for (int t = 0; t < TICKS; ++t) {
+            if (t % 2 == 0) botThink(1.f / 60.f);
+            simulateTick(1.f / 120.f);
+        }
+        while (!descentNextReady()) std::this_thread::yield();
+        g_floor.cleared.w = g_floor.exists.w;
+        checkAllCleared();
+        if (g_descent.depth == 1000) bytesAt1k = descentResidentBytes();
+    }
+    size_t bytesAtEnd = descentResidentBytes();
+    descentReport();
+    double sum0 = g_descent.latUs.sum;
+    uint64_t waits0 = g_descent.waits;
+    for (int f = 0; f < RUSHED; ++f) {
+        g_floor.cleared.w = g_floor.exists.w;
+        checkAllCleared();
+    }
+    printf("descent: %d more back to back: latency mean %.1f us, %llu waits for the worker\n", RUSHED,
+        (g_descent.latUs.sum - sum0) / RUSHED, (unsigned long long)(g_descent.waits - waits0));
+    descentStop();
+    bool ok = bytesAtEnd == bytesAt1k && g_descent.logged.load() == uint64_t(FLOORS + RUSHED);
+    if (!ok) printf("descent: MISMATCH (%zu bytes resident at floor 1000, %zu at %d, %llu summaries)\n",
+        bytesAt1k, bytesAtEnd, FLOORS, (unsigned long long)g_descent.logged.load());
+    g_player = Player{};
+    return ok;
+}
+
+// Taps from a second thread standing in for the OS, 2-14 ms long, consumed by a
+// 60 fps frame loop running 120 Hz ticks: the event queue against polling the key
+// once per frame the way GetAsyncKeyState was used.
+static bool benchInput() {
+    const int TAPS = 150, VK = 'X';
+    const double FRAME = 1.0 / 60, TICK = 1.0 / 120;
+    InputState& I = g_input;
+    InputEvent drop;
+    while (I.queue.pop(drop)) {}
+    memset(I.sent, 0, sizeof(I.sent)); memset(I.down, 0, sizeof(I.down)); I.hasNext = false;
+    I.tickMs = LatencyStats{};
+    std::atomic<bool> held{ false }, done{ false };
+    std::atomic<double> pressedAt{ 0.0 };
+    std::thread producer([&] {
+        std::mt19937 rng(72);
+        for (int i = 0; i < TAPS; ++i) {
+            std::this_thread::sleep_for(std::chrono::microseconds(4000 + rng() % 20000));
+            double t = nowSeconds();
+            pressedAt = t; held = true;
+            inputPush(VK, true, t);
+            std::this_thread::sleep_for(std::chrono::microseconds(2000 + rng() % 12000));
+            held = false;
+            inputPush(VK, false, nowSeconds());
+        }
+        done = true;
+    });
+    int polled = 0;
+    bool polledWas = false;
+    LatencyStats pollMs;
+    double t0 = nowSeconds(), acc = 0;
+    while (!done || I.hasNext || I.queue.head.load() != I.queue.tail.load()) {
+        double t1 = nowSeconds();
+        acc += t1 - t0; t0 = t1;
+        bool h = held;
+        if (h && !polledWas) { ++polled; pollMs.add((t1 - pressedAt) * 1e3); }
+        polledWas = h;
+        while (acc >= TICK) {
+            acc -= TICK;
+            I.until = t1 - acc;
+            inputTick();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(int(FRAME * 1e6)));
+    }
+    producer.join();
+    I.until = 1e300;
+    const LatencyStats& Q = I.tickMs;
+    int queued = int(Q.n);
+    printf("input: %d taps, polled once a frame: %d seen, latency mean %.2f ms, p99 %.2f ms\n",
+        TAPS, polled, pollMs.mean(), pollMs.pct(0.99));
+    printf("input: %d taps, event queue: %d applied, input-to-tick mean %.2f ms, p99 %.2f ms, max %.2f ms\n",
+        TAPS, queued, Q.mean(), Q.pct(0.99), Q.max);
+    bool ok = queued == TAPS && I.dropped == 0;
+    if (!ok) printf("input: MISMATCH (%d of %d taps applied, %llu dropped)\n", queued, TAPS, (unsigned long long)I.dropped);
+    // A release that finds the queue full must still go out once there is room.
+    inputPush(VK, true, 0);
+    for (int vk = 0; I.queue.tail.load() - I.queue.head.load() < 256; vk ^= 1) inputPush('Y', vk != 0, 0);
+    inputPush(VK, false, 0);
+    while (I.queue.pop(drop)) {}
+    inputPush(VK, false, 0);
+    bool retried = I.queue.pop(drop) && drop.vk == VK && !drop.down;
+    if (!retried) printf("input: MISMATCH (release lost after a full queue)\n");
+    ok = ok && retried;
+    memset(I.sent, 0, sizeof(I.sent));
+    I.dropped = 0;
+    I.tickMs = LatencyStats{};
+    return ok;
+}
+
+// Bot play with every zone profiled and the counters on where the system has them.
+static void benchProfile() {
+    const int FRAMES = 300;
+    benchScene();
+    profStart(true);
+    for (int f = 0; f < FRAMES; ++f) {
+        botThink(1.f / 60.f);
+        if (g_runOver) resetRun();
+        simulateTick(1.f / 120.f); simulateTick(1.f / 120.f);
+        renderFrame();
+        profFrame();
+    }
+    profReport();
+    profStop();
+}
+
+// Cost of the hot-path increment against a plain one, then a real scrape over
+// loopback checked against the registry.
+static bool benchMetrics() {
+    const int N = 10000000;
+    volatile int64_t plain = 0;
+    double t0 = nowSeconds();
+    for (int i = 0; i < N; ++i) plain = plain + 1;
+    double t1 = nowSeconds();
+    for (int i = 0; i < N; ++i) metricAdd(M_TICKS);
+    double t2 = nowSeconds();
+    printf("metrics: relaxed atomic add %.2f ns, plain volatile add %.2f ns\n", (t2 - t1) * 1e9 / N, (t1 - t0) * 1e9 / N);
+
+    if (!metricsStart(0)) { printf("metrics: no loopback socket, scrape skipped\n"); return true; }
+    metricSet(M_DEPTH, 4242);
+    std::string resp;
+    double t3 = nowSeconds();
+    SOCKET c = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET; addr.sin_port = htons(u_short(g_metricsServer.port)); addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (c != INVALID_SOCKET && connect(c, (sockaddr*)&addr, sizeof(addr)) == 0) {
+        const char* get = "GET /metrics HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        if (sendAll(c, (const uint8_t*)get, strlen(get))) {
+            char buf[4096];
+            for (int k; (k = recv(c, buf, sizeof(buf), 0)) > 0;) resp.append(buf, size_t(k));
+        }
+    }
+    if (c != INVALID_SOCKET) closesocket(c);
+    double ms = (nowSeconds() - t3) * 1e3;
+    metricSet(M_DEPTH, g_descent.depth);
+    metricsStop();
+    bool ok = resp.compare(0, 15, "HTTP/1.1 200 OK") == 0 && resp.find("\nisaac_floor_depth 4242\n") != std::string::npos &&
+        resp.find("# TYPE isaac_ticks_total counter\n") != std::string::npos &&
+        resp.find("isaac_frame_seconds_count ") != std::string::npos;
+    printf("metrics: scrape %.2f ms, %zu bytes\n", ms, resp.size());
+    if (!ok) printf("metrics: scrape MISMATCH:\n%s\n", resp.c_str());
+    return ok;
+}
+
+// Every post pass at full resolution on a gameplay frame, then the same frames under a
+// budget too small for all of them to show the passes stepping down.
+static void benchPost() {
+    benchScene();
+    PostFx saved = g_post;
+    g_post.crt = true;
+    const int FRAMES = 200;
+    for (double budget : { 100.0, 1.0 }) {
+        g_post.budgetMs = budget;
+        for (int p = 0; p < POST_COUNT; ++p) { g_post.level[p] = PostLevel::Full; g_post.costMs[p] = 0; }
+        double t0 = nowSeconds();
+        for (int f = 0; f < FRAMES; ++f) {
+            g_screenFx.flash = g_screenFx.shake = 1.f;
+            g_screenFx.time += 1.f / 60.f;
+            postProcess();
+        }
+        printf("post %d threads, %.2f ms/frame: ", jobThreads(), (nowSeconds() - t0) * 1e3 / FRAMES);
+        postReport();
+    }
+    g_post = saved;
+    g_screenFx = ScreenFx{};
+}
+
+// Present latency: one full-window blit each, timed until the image may be written
+// again. On X11 the same image goes out once via MIT-SHM (until its completion event)
+// and once through plain XPutImage (until it has been copied to the connection).
+static void benchPresent() {
+    const int FRAMES = 200;
+    GameWindow win;
+    if (!openWindow(win, TEXT("Mini Isaac-like (bench)"), WIDTH, HEIGHT)) {
+        printf("present: no display, skipped\n");
+        return;
+    }
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) win.pixels[i] = RGBA(uint8_t(i), uint8_t(i >> 8), 90);
+    auto run = [&](const char* name) {
+        std::vector<double> ms;
+        for (int i = 0; i < FRAMES; ++i) {
+            win.pixels[i] ^= 0xffffff; // something changes every frame
+            double t0 = nowSeconds();
+            presentWindow(win);
+            waitForImage(win);
+#ifndef _WIN32
+            if (!win.useShm) XSync(win.dpy, False); // until the server has taken the put, as the XShm completion is
+#endif
+            ms.push_back((nowSeconds() - t0) * 1e3);
+            pumpMessages(win);
+        }
+        printf("present %-9s %dx%d: median %.3f ms, p99 %.3f ms\n", name, WIDTH, HEIGHT, percentile(ms, 0.5), percentile(ms, 0.99));
+    };
+#ifdef _WIN32
+    run("BitBlt");
+#else
+    if (win.hasShm) run("XShm");
+    else printf("present: MIT-SHM unavailable on this display\n");
+    win.useShm = false;
+    run("XPutImage");
+    win.useShm = win.hasShm;
+#endif
+    closeWindow(win);
+}
+
+// CPU on a static game-over screen, per wall second: the old loop (render, Sleep(1))
+// against the idle path (key check, then a timed wait in place of the input wait).
+// Headless, so presentation is in neither figure.
+static void benchIdle() {
+    benchScene();
+    g_runOver = true;
+    const double SECS = 1.0;
+    auto measure = [&](bool idle, uint64_t& frames) {
+        uint64_t lastKey = sceneKey();
+        renderFrame();
+        frames = 0;
+        double c0 = processCpuSeconds(), w0 = nowSeconds();
+        while (nowSeconds() - w0 < SECS) {
+            ++frames;
+            uint64_t key = sceneKey();
+            if (idle && key == lastKey) { Sleep(IDLE_WAIT_MS); continue; }
+            renderFrame();
+            lastKey = key;
+            Sleep(1);
+        }
+        return 100.0 * (processCpuSeconds() - c0) / (nowSeconds() - w0);
+    };
+    uint64_t busyFrames, idleFrames;
+    double busy = measure(false, busyFrames), idle = measure(true, idleFrames);
+    printf("idle screen: every frame %.1f%% of a core (%llu frames/s), idle wait %.2f%% (%llu wakeups/s)\n",
+        busy, (unsigned long long)busyFrames, idle, (unsigned long long)idleFrames);
+    g_runOver = false;
+}
+
+static int runBenchmarks() {
+    jobsStart();
+    atlasLoad(g_atlas, "");
+    benchMixer();
+    benchScreenshot();
+    bool ok = benchStream();
+    benchSim();
+    ok = benchVecMath() && ok;
+    benchTickRate();
+    ok = benchSprites() && ok;
+    benchCircles();
+    ok = benchLighting() && ok;
+    ok = benchPixelFormats() && ok;
+    ok = benchIndexed() && ok;
+    ok = benchDrawList() && ok;
+    ok = benchPrimitives() && ok;
+    ok = benchFloor() && ok;
+    ok = benchDescent() && ok;
+    ok = benchInput() && ok;
+    ok = benchMetrics() && ok;
+    benchPost();
+    benchProfile();
+    benchIdle();
+    benchPresent();
+    atlasFree(g_atlas);
+    jobsStop();
+    return ok ? 0 : 1;
+}
+
+static int runHeadless(const Options& opt) {
+    std::vector<uint32_t> fb(size_t(WIDTH) * HEIGHT);
+    g_fb.px = fb.data(); g_fb.w = WIDTH; g_fb.h = HEIGHT;
+    g_headless = true;
+    if (!opt.endlessLog.empty()) descentOpen(opt.endlessLog);
+    resetRun();
+    atlasLoad(g_atlas, opt.atlasPath);
+    g_post.crt = opt.crt; g_post.budgetMs = opt.postBudgetMs;
+    g_indexed.on = opt.pal8;
+    g_trace.overlay = opt.overlay;
+    if (opt.profile) profStart(true);
+    jobsStart();
+    screenshotStart(WIDTH, HEIGHT);
+    audioStart(opt.audio == AudioSink::Device ? AudioSink::Null : opt.audio, opt.wavPath);
+    if (!opt.capturePath.empty() && !captureStart(opt.capturePath, WIDTH, HEIGHT))
+        fprintf(stderr, "capture: cannot open %s\n", opt.capturePath.c_str());
+    if (opt.streamPort && !streamStart(opt.streamPort, WIDTH, HEIGHT))
+        fprintf(stderr, "stream: cannot listen on port %d\n", opt.streamPort);
+    if (opt.metricsPort && !metricsStart(opt.metricsPort))
+        fprintf(stderr, "metrics: cannot listen on port %d\n", opt.metricsPort);
+    bool shm = !opt.shmName.empty() && shmExportStart(g_shm, opt.shmName, WIDTH, HEIGHT);
+    if (!opt.shmName.empty() && !shm) fprintf(stderr, "shm: cannot create segment %s\n", opt.shmName.c_str());
+
+    const float frameDt = 1.f / 60.f, dt = 1.f / float(opt.tickHz);
+    int runs = 0;
+    int64_t ticks = 0;
+    double t0 = nowSeconds(), tFrame = t0;
+    for (int frame = 0; frame < opt.headlessFrames; ++frame) {
+        botThink(frameDt);
+        if (g_runOver && keyDown('R')) { resetRun(); ++runs; }
+        for (int64_t due = int64_t(frame + 1) * opt.tickHz / 60; ticks < due; ++ticks) simulateTick(dt);
+        if (shm) g_fb.px = shmBeginFrame(g_shm);
+        renderFrame();
+        if (shm) shmPublish(g_shm);
+        captureFrame(g_fb.px);
+        streamFrame(g_fb.px);
+        tracePresented();
+        profFrame();
+        metricsSample();
+        double tNow = nowSeconds();
+        metricFrame(tNow - tFrame); tFrame = tNow;
+        if (frame == opt.shotFrame) requestScreenshot(g_fb.px, "shot_" + std::to_string(frame));
+    }
+    double secs = nowSeconds() - t0;
+    if (shm) { g_fb.px = fb.data(); shmExportStop(g_shm); }
+    metricsStop();
+    streamStop();
+    captureStop();
+    screenshotStop();
+    audioStop();
+    jobsStop();
+    atlasFree(g_atlas);
+    printf("headless: %d frames in %.2f s (%.0f fps), %d restarts\n",
+        opt.headlessFrames, secs, opt.headlessFrames / secs, runs);
+    drawListReport();
+    postReport();
+    inputReport();
+    traceReport();
+    if (g_prof.on) { profReport(); profStop(); }
+    if (g_descent.on) { descentStop(); descentReport(); }
+    return 0;
+}
+
+static int gameMain(const char* cmdLine) {
+    Options opt = parseOptions(cmdLine);
+    if (opt.seeded) g_rng.eng.seed(opt.seed);
+    if (opt.hashTicks > 0) return runHashTicks(opt);
+    if (opt.bench) return runBenchmarks();
+    if (opt.headlessFrames > 0) return runHeadless(opt);
+    if (opt.viewPort) return runViewer(opt.viewPort);
+    if (!opt.shmRead.empty()) return runShmReader(opt.shmRead);
+
+    // Window + backbuffer
+    GameWindow win;
+    if (!openWindow(win, TEXT("Mini Isaac-like"), WIDTH, HEIGHT)) {
+        fprintf(stderr, "could not open a window\n");
+        return 1;
+    }
+    g_pixels = win.pixels;
+    g_fb.px = win.pixels; g_fb.w = WIDTH; g_fb.h = HEIGHT;
+
+    // Game init
+    if (!opt.endlessLog.empty()) descentOpen(opt.endlessLog);
+    resetRun();
+    atlasLoad(g_atlas, opt.atlasPath);
+    g_post.crt = opt.crt; g_post.budgetMs = opt.postBudgetMs;
+    g_indexed.on = opt.pal8;
+    g_trace.overlay = opt.overlay;
+    if (opt.profile) fprintf(stderr, "profile: only available with -headless, ignored\n");
+    jobsStart();
+    screenshotStart(WIDTH, HEIGHT);
+    audioStart(opt.audio, opt.wavPath);
+    if (!opt.capturePath.empty()) captureStart(opt.capturePath, WIDTH, HEIGHT);
+    if (opt.streamPort) streamStart(opt.streamPort, WIDTH, HEIGHT);
+    if (opt.metricsPort && !metricsStart(opt.metricsPort))
+        fprintf(stderr, "metrics: cannot listen on port %d\n", opt.metricsPort);
+    bool shm = !opt.shmName.empty() && shmExportStart(g_shm, opt.shmName, WIDTH, HEIGHT);
+    if (shm && !shmAttachWindow(g_shm, win)) { shmExportStop(g_shm); shm = false; }
+    bool shotKeyWas = false, overlayKeyWas = false;
+    int shotIndex = 0;
+    // Idle frames: the scene key matched the last presented frame. CPU and wall time
+    // spent in them are summed whether or not they are skipped, so -no-idle gives the
+    // comparison figure.
+    bool drawn = false, idleWas = false;
+    uint64_t lastKey = 0, frames = 0, skipped = 0;
+    double idleCpu = 0, idleWall = 0, idleCpu0 = 0, idleWall0 = 0;
+
+    double t0 = nowSeconds(), tFrame = t0;
+    double acc = 0.0, dt = 1.0 / opt.tickHz; // fixed update, 120 Hz by default
+    while (g_running) {
+        if (!pumpMessages(win)) break;
+
+        if (keyDown(VK_ESCAPE)) { g_running = false; break; }
+        if (g_runOver && keyDown('R')) { resetRun(); }
+
+        double t1 = nowSeconds();
+        acc += t1 - t0; t0 = t1;
+
+        // fixed update loop; each tick takes the input stamped up to its wall time
+        while (acc >= dt) {
+            acc -= dt;
+            g_input.until = t1 - acc;
+            simulateTick((float)dt);
+        }
+
+        // The capture file runs at a fixed frame rate, so it keeps getting every frame.
+        uint64_t key = sceneKey();
+        bool still = drawn && key == lastKey && !g_capture.run.load(std::memory_order_relaxed);
+        if (still != idleWas) {
+            double c = processCpuSeconds(), w = nowSeconds();
+            if (still) { idleCpu0 = c; idleWall0 = w; }
+            else { idleCpu += c - idleCpu0; idleWall += w - idleWall0; }
+            idleWas = still;
+        }
+        ++frames;
+        bool skip = still && opt.idle;
+        if (skip) {
+            ++skipped;
+            traceNothingShown();
+            if (g_repaint) presentWindow(win);
+        }
+        else {
+            // render
+            if (shm) {
+                g_fb.px = shmBeginFrame(g_shm);
+                shmWindowSlot(g_shm, win);
+            }
+            else waitForImage(win); // the framebuffer may be the image the last present handed over
+            renderFrame();
+
+            presentWindow(win);
+            tracePresented();
+            if (shm) shmPublish(g_shm);
+            captureFrame(g_fb.px);
+            streamFrame(g_fb.px);
+            drawn = true; lastKey = key;
+            double tNow = nowSeconds();
+            metricFrame(tNow - tFrame); tFrame = tNow;
+        }
+        metricsSample();
+        g_repaint = false;
+        bool shotKey = keyDown(VK_F12);
+        if (shotKey && !shotKeyWas) {
+            char name[32];
+            snprintf(name, sizeof(name), "shot_%04d", ++shotIndex);
+            requestScreenshot(g_fb.px, name);
+        }
+        shotKeyWas = shotKey;
+        bool overlayKey = keyDown(VK_F3);
+        if (overlayKey && !overlayKeyWas) g_trace.overlay = !g_trace.overlay;
+        overlayKeyWas = overlayKey;
+        if (skip) {
+            // Block until input arrives or the next tick could change something; the
+            // wait itself must not be simulated as one long catch-up step.
+            waitForInput(win, IDLE_WAIT_MS);
+            t0 = nowSeconds(); acc = 0.0;
+        }
+        else Sleep(1);
+    }
+    if (idleWas) { idleCpu += processCpuSeconds() - idleCpu0; idleWall += nowSeconds() - idleWall0; }
+    printf("idle: %llu of %llu frames skipped; %.1f s static at %.1f%% of a core\n",
+        (unsigned long long)skipped, (unsigned long long)frames, idleWall,
+        idleWall > 0 ? 100.0 * idleCpu / idleWall : 0.0);
+
+    // cleanup
+    metricsStop();
+    streamStop();
+    captureStop();
+    screenshotStop();
+    audioStop();
+    jobsStop();
+    if (shm) { shmDetachWindow(g_shm, win); shmExportStop(g_shm); }
+    atlasFree(g_atlas);
+    closeWindow(win);
+    inputReport();
+    traceReport();
+    if (g_descent.on) { descentStop(); descentReport(); }
+    return 0;
+}
+
+#ifdef _WIN32
+int APIENTRY WinMain(HINSTANCE, HINSTANCE, LPSTR cmdLine, int) {
+    return gameMain(cmdLine);
+}
+#else
+int main(int argc, char** argv) {
+    std::string cmdLine;
+    for (int i = 1; i < argc; ++i) { if (i > 1) cmdLine += ' '; cmdLine += argv[i]; }
+    return gameMain(cmdLine.c_str());
 }
+#endif